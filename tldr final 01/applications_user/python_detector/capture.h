@@ -0,0 +1,37 @@
+// Capture file format, shared by the app and the host replay tool.
+// Layout: a CapHeader padded to CAP_HDR bytes, then CapRec records back to
+// back; the header is rewritten with totals when a capture stops.
+#pragma once
+#include <stdint.h>
+
+#define CAP_HDR            512    // header block; records start after it
+#define CAP_MAGIC          0x50435354U // "TSCP"
+#define CAP_VERSION        2      // 2: CAP_SUB records
+#define CAP_PEAK           1      // CapRec.flags: confirmed detection
+#define CAP_TGT            2      // ... revisit of an active target
+#define CAP_CAND           4      // ... quick sample earned a dwell
+#define CAP_REJ            8      // ... carrier failed classification
+#define CAP_SUB            16     // not a visit: a dwell/confirmation read, ahead of its visit record
+
+typedef struct __attribute__((packed)) {
+    uint32_t tick;
+    uint32_t freq;
+    uint16_t ch;
+    int16_t rssi;  // 0.5 dB units
+    int16_t thr;   // 0.5 dB units
+    uint8_t flags;
+    uint8_t rsvd;
+} CapRec;
+typedef struct __attribute__((packed)) {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t hdr_size;
+    uint16_t rec_size;
+    uint16_t rssi_div;  // rssi/thr divisor to dBm
+    uint32_t tick_hz;
+    uint32_t plan;      // plan hash, matches the cal_*.bin name
+    uint32_t num_ch;
+    uint32_t records;
+    uint32_t dropped;
+} CapHeader;
+_Static_assert(sizeof(CapRec) == 16, "capture records must stay 16 bytes");
@@ -0,0 +1,198 @@
+#include "detector.h"
+
+DetParams det = {THRESH_DB, 3, TGT_RSSI_DROP, TGT_HOLD_MS};
+Baseline baseline;
+TargetTable tgt;
+static const DetRadio* radio_if;
+// Recently rejected carriers, kept out of the dwell for REJ_HOLD_MS
+static struct {
+    uint16_t ch[REJ_MAX];
+    uint32_t until[REJ_MAX];
+    size_t n;
+} rej;
+// Confirmation hits (of CONFIRM_M) needed at each sens level
+static const uint8_t confirm_need[6] = {CONFIRM_M, 7, 6, 5, 4, 3};
+// Threshold relief at each sens level
+static const Rssi sens_off[6] = {0, RSSI_DB(1), RSSI_DB(2), RSSI_DB(3), RSSI_DB(4), RSSI_DB(5)};
+
+void det_init(const DetRadio* radio) {
+    radio_if = radio;
+    tgt.n = 0;
+    rej.n = 0;
+}
+
+uint32_t isqrt(uint32_t v) {
+    uint32_t r = 0;
+    for(uint32_t b = 1U << 30; b; b >>= 2) {
+        if(v >= r + b) { v -= r + b; r = (r >> 1) + b; }
+        else r >>= 1;
+    }
+    return r;
+}
+// Detection margin over the floor, widened on channels with a noisy floor.
+// Most channels are quiet enough for the fixed margin, which is decided on
+// the squares without a root.
+Rssi noise_margin(size_t ch) {
+    uint32_t t = RSSI_DB(det.thresh_db);
+    uint32_t v = (uint32_t)baseline.var[ch] << RSSI_Q;
+    if(CAL_SIGMA_K * CAL_SIGMA_K * v <= t * t) return t;
+    uint32_t m = CAL_SIGMA_K * isqrt(v);
+    return m > t ? m : t;
+}
+static void thr_update(size_t ch) {
+    baseline.thr[ch] = baseline.med[ch] + noise_margin(ch);
+}
+// Rebuild the threshold table after calibration or a thresh_db change
+void det_rethr(size_t n) {
+    for(size_t ch=0;ch<n;ch++) thr_update(ch);
+}
+// Sensitivity and target relief lower the threshold, but never closer to
+// the floor than half its margin, or plain noise starts confirming
+static inline Rssi thr_min(size_t ch) { return (baseline.thr[ch] + baseline.med[ch]) / 2; }
+Rssi chan_thr(size_t ch) {
+    Rssi t = baseline.thr[ch] - sens_off[det.sens];
+    return t > thr_min(ch) ? t : thr_min(ch);
+}
+// Revisit threshold of a target
+Rssi tgt_thr(size_t ch) {
+    Rssi t = baseline.thr[ch] - sens_off[det.sens] - RSSI_DB(det.tgt_drop_db);
+    return t > thr_min(ch) ? t : thr_min(ch);
+}
+// Running median: a fixed step towards each sample settles where half the
+// samples are on either side, whatever the noise spread
+Rssi median_step(Rssi m, Rssi r) {
+    return r > m ? m + FLOOR_STEP : r < m ? m - FLOOR_STEP : m;
+}
+// Online floor tracking, fed with every sample that isn't a detection.
+// Candidates count too, or the floor would only ever see the lower part
+// of the noise and settle below it. The spread is measured around the
+// tracked median, so a noisier site raises the threshold.
+void floor_update(size_t ch, Rssi r) {
+    int32_t d = r - baseline.med[ch];
+    baseline.med[ch] = median_step(baseline.med[ch], r);
+    if(d > RSSI_DB(FLOOR_VAR_DB)) d = RSSI_DB(FLOOR_VAR_DB);
+    if(d < -RSSI_DB(FLOOR_VAR_DB)) d = -RSSI_DB(FLOOR_VAR_DB);
+    int32_t v = baseline.var[ch];
+    v += (((d*d) >> RSSI_Q) - v) >> FLOOR_VAR;
+    baseline.var[ch] = v < 0 ? 0 : v > UINT16_MAX ? UINT16_MAX : v;
+    thr_update(ch);
+}
+
+// Burst confirmation: m RSSI samples at fixed spacing across one slot,
+// returns how many were at or above threshold
+uint8_t confirm(Rssi threshold, uint8_t m) {
+    void* ctx = radio_if->ctx;
+    uint32_t t0 = radio_if->stamp(ctx);
+    uint32_t gap = SLOT_US / m;
+    uint8_t hits = 0;
+    for(uint8_t k=0;k<m;k++) {
+        if(k) radio_if->wait_until(ctx, t0, k * gap);
+        if(radio_if->rssi(ctx) >= threshold) hits++;
+    }
+    return hits;
+}
+bool confirmed(uint8_t hits) { return hits >= confirm_need[det.sens]; }
+
+// Classification: one frame of on/off envelope at ENV_STEP_US. Above
+// CLS_CONT_PCT duty it is a continuous carrier. Otherwise each slot phase
+// is tried; TETRA bursts fill whole slots, so at the right phase nearly
+// every step agrees with its slot's majority. Frames repeat, so the
+// envelope is treated as circular.
+SigInfo classify(Rssi threshold) {
+    void* ctx = radio_if->ctx;
+    SigInfo s = {SigNone, 0, 0, 0, radio_if->stamp(ctx), INT16_MIN};
+    bool env[ENV_N];
+    size_t on = 0;
+    for(size_t k=0;k<ENV_N;k++) {
+        if(k) radio_if->wait_until(ctx, s.t0, k * ENV_STEP_US);
+        Rssi r = radio_if->rssi(ctx);
+        env[k] = r >= threshold;
+        on += env[k];
+        if(r > s.peak) s.peak = r;
+    }
+    s.duty = on * 100 / ENV_N;
+    if(!on) return s;
+    if(s.duty >= CLS_CONT_PCT) { s.cls = SigCont; return s; }
+    s.cls = SigOther;
+    if(s.duty < CLS_MIN_PCT) return s;
+    size_t best = 0;
+    for(size_t p=0;p*ENV_STEP_US<SLOT_US;p++) {
+        uint8_t cnt[4] = {0}, len[4] = {0};
+        for(size_t k=0;k<ENV_N;k++) {
+            size_t sl = (k + ENV_N - p) % ENV_N * ENV_STEP_US / SLOT_US;
+            if(sl > 3) sl = 3;
+            cnt[sl] += env[k];
+            len[sl]++;
+        }
+        uint8_t occ = 0;
+        size_t agree = 0;
+        for(size_t sl=0;sl<4;sl++) {
+            bool busy = cnt[sl] * 2 > len[sl];
+            occ |= busy << sl;
+            agree += busy ? cnt[sl] : len[sl] - cnt[sl];
+        }
+        if(agree > best) { best = agree; s.occ = occ; s.phase = p; }
+    }
+    if(s.occ && best * 100 >= CLS_ALIGN_PCT * ENV_N) s.cls = SigTdma;
+    return s;
+}
+// Slot-timed bursts always pass; a continuous carrier only on a beacon
+// channel, where base station control carriers transmit in every slot
+bool sig_accept(const SigInfo* s, bool beacon) {
+    return s->cls == SigTdma || (s->cls == SigCont && beacon);
+}
+void det_reject(size_t ch, uint32_t now) {
+    size_t k = 0;
+    while(k < rej.n && rej.ch[k] != ch) k++;
+    if(k == rej.n) {
+        if(rej.n < REJ_MAX) rej.n++;
+        else {
+            // Full: reuse the entry that runs out first
+            k = 0;
+            for(size_t j=1;j<rej.n;j++) if((int32_t)(rej.until[j] - rej.until[k]) < 0) k = j;
+        }
+    }
+    rej.ch[k] = ch;
+    rej.until[k] = now + REJ_HOLD_MS;
+}
+bool det_rejected(size_t ch, uint32_t now) {
+    for(size_t k=0;k<rej.n;k++)
+        if(rej.ch[k] == ch) return (int32_t)(now - rej.until[k]) < 0;
+    return false;
+}
+
+int tgt_find(size_t ch) {
+    for(size_t k=0;k<tgt.n;k++) if(tgt.t[k].ch == ch) return k;
+    return -1;
+}
+void tgt_remove(size_t k) {
+    tgt.t[k] = tgt.t[--tgt.n];
+}
+// Record a confirmed hit; true if it is a new target
+bool tgt_hit(size_t ch, Rssi r, uint32_t now) {
+    int k = tgt_find(ch);
+    if(k >= 0) {
+        Target* t = &tgt.t[k];
+        t->hits++;
+        t->miss = 0;
+        t->last = now;
+        if(r > t->peak) t->peak = r;
+        t->avg += (r - t->avg) >> TGT_AVG;
+        return false;
+    }
+    if(tgt.n < TGT_MAX) k = tgt.n++;
+    else {
+        k = 0;
+        for(size_t j=1;j<tgt.n;j++) if(tgt.t[j].avg < tgt.t[k].avg) k = j;
+        if(tgt.t[k].avg >= r) return false;
+    }
+    tgt.t[k] = (Target){ch, 1, 0, 0, now, now, r, r};
+    return true;
+}
+// Drop targets not heard for hold_ms; true if any went
+bool tgt_expire(uint32_t now) {
+    bool changed = false;
+    for(size_t k=tgt.n;k-- > 0;)
+        if(now - tgt.t[k].last > det.hold_ms) { tgt_remove(k); changed = true; }
+    return changed;
+}
@@ -0,0 +1,121 @@
+// Detector core: baseline, thresholds, burst confirmation and the target
+// table. Knows nothing about the Flipper; RSSI and time come through
+// DetRadio, so the same code runs on the device and in the host replay tool.
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define MIN_RSSI_DBM       -80
+// RSSI is fixed point end to end: dBm in Q7 (1/128 dB) in an int16, which
+// covers +-256 dB. Floats only appear when formatting for display.
+#define RSSI_Q             7
+#define RSSI_DB(x)         ((x) * (1 << RSSI_Q))
+#define RSSI_TO_F(r)       ((float)(r) / (1 << RSSI_Q))
+#define CAL_SIGMA_K        3      // noisy channels widen their margin to K*sd
+#define FLOOR_STEP         16     // floor median tracking step, Q7 (1/8 dB)
+#define FLOOR_VAR          7      // floor spread averaging gain, 2^-N
+#define FLOOR_VAR_DB       10     // deviation clamp for the spread, so a carrier can't blow it up
+#define THRESH_DB          8
+#define SLOT_US            14167  // TETRA slot is 85/6 ms
+#define FRAME_US           (4 * SLOT_US)
+#define ENV_STEP_US        1000   // classification envelope step
+#define ENV_N              ((FRAME_US + ENV_STEP_US - 1) / ENV_STEP_US) // steps over a frame
+#define CONFIRM_M          7      // confirmation samples spread over one slot
+#define PRE_DB             3      // quick-sample margin below thr that earns a dwell
+#define TGT_MAX            8      // active targets tracked at once
+#define TGT_HOLD_MS        20000  // target dropped this long after its last hit
+#define TGT_RSSI_DROP      5      // threshold relief on a known target
+#define TGT_AVG            3      // target RSSI average gain, 2^-N
+#define CLS_CONT_PCT       90     // duty cycle of a continuous carrier
+#define CLS_MIN_PCT        15     // below this the bursts are too short for a slot
+#define CLS_ALIGN_PCT      90     // envelope agreement with a slot-aligned mask
+#define CLS_NB_DB          6      // neighbour this close to the carrier: wideband
+#define REJ_MAX            8      // rejected carriers remembered at once
+#define REJ_HOLD_MS        5000   // no dwell on a rejected carrier for this long
+
+typedef int16_t Rssi;
+
+// Where samples come from. stamp() is a free-running counter and
+// wait_until(t0, us) returns `us` after stamp t0.
+typedef struct {
+    Rssi (*rssi)(void* ctx);
+    uint32_t (*stamp)(void* ctx);
+    void (*wait_until)(void* ctx, uint32_t t0, uint32_t us);
+    void* ctx;
+} DetRadio;
+
+// Tunables, runtime so the replay tool can sweep them
+typedef struct {
+    int thresh_db;   // minimum margin over the floor
+    int sens;        // 1..5, lowers the threshold and the confirmation count
+    int tgt_drop_db; // threshold relief on a known target
+    uint32_t hold_ms;
+} DetParams;
+
+// Noise floor per channel, seeded by calibration and tracked while
+// scanning; med and var are contiguous and saved to SD as one blob
+typedef struct {
+    uint32_t plan;
+    Rssi* med;
+    uint16_t* var; // dB^2 in Q7
+    Rssi* thr;     // floor plus margin, kept current by floor_update
+} Baseline;
+
+// Active target: a channel with a confirmed detection in the last hold_ms
+typedef struct {
+    uint16_t ch;
+    uint16_t hits;
+    uint8_t miss;         // revisits since the last hit
+    uint8_t visits;
+    uint32_t first, last; // ms of the first and latest hit
+    Rssi peak, avg;
+} Target;
+
+// Target table; fixed capacity, the weakest target makes room for a new one
+typedef struct {
+    Target t[TGT_MAX];
+    size_t n;
+} TargetTable;
+
+// What a confirmed carrier looks like over one frame
+typedef enum {
+    SigNone,  // gone before it could be classified
+    SigTdma,  // bursts on the 14.17 ms slot grid
+    SigCont,  // on for the whole frame
+    SigOther, // irregular or too short for a slot
+} SigClass;
+typedef struct {
+    SigClass cls;
+    uint8_t duty;   // percent of the frame above threshold
+    uint8_t occ;    // busy slot mask, SigTdma only
+    uint8_t phase;  // envelope step where slot 0 starts, SigTdma only
+    uint32_t t0;    // stamp of the first envelope step
+    Rssi peak;
+} SigInfo;
+
+extern DetParams det;
+extern Baseline baseline;
+extern TargetTable tgt;
+
+void det_init(const DetRadio* radio);
+
+uint32_t isqrt(uint32_t v);
+Rssi noise_margin(size_t ch);
+void det_rethr(size_t n);
+Rssi chan_thr(size_t ch);
+Rssi tgt_thr(size_t ch);
+Rssi median_step(Rssi m, Rssi r);
+void floor_update(size_t ch, Rssi r);
+
+uint8_t confirm(Rssi threshold, uint8_t m);
+bool confirmed(uint8_t hits);
+SigInfo classify(Rssi threshold);
+bool sig_accept(const SigInfo* s, bool beacon);
+void det_reject(size_t ch, uint32_t now);
+bool det_rejected(size_t ch, uint32_t now);
+
+int tgt_find(size_t ch);
+void tgt_remove(size_t k);
+bool tgt_hit(size_t ch, Rssi r, uint32_t now);
+bool tgt_expire(uint32_t now);
@@ -0,0 +1,321 @@
+// Host replay: drives the detector core (detector.c) from capture files
+// (capture.h) as fast as the host allows and reports how the given
+// parameters would have done.
+//
+//   tetra_replay [-s sens] [-T thresh_db] [-d drop_db] [-H hold_ms]
+//                [-t truth_dbm] [-n repeat] [-S stats.csv] capture.bin...
+//
+// Every visit record is replayed as a scan visit of its channel at its
+// tick, through the same threshold, floor tracking, confirmation and
+// target table code as the app. Confirmation reads come from the CAP_SUB
+// records the device logged ahead of the visit, at their own ticks and
+// from the one that would have ended the dwell, so slot-timed bursts are
+// confirmed the way the device saw them. A visit with no logged reads
+// (a version 1 capture, or one the device didn't dwell on) falls back to
+// the channel's next visit records, one per read, and is counted in the
+// report. Ground truth is the capture's own CAP_PEAK decisions, or with
+// -t every visit at or above truth_dbm. -S writes the per-channel
+// statistics the app exports, one block of lines per file.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "detector.h"
+#include "capture.h"
+#include "stats.h"
+
+#define SEED_N  10 // first quiet samples per channel that seed its floor
+#define REC_NONE SIZE_MAX
+
+static struct {
+    uint32_t us;
+    uint32_t hz;
+    const CapRec* recs;
+    const size_t* next; // next visit of the same channel, REC_NONE after the last
+    size_t cur;         // record the last read came from
+    size_t sub_end;     // logged reads end here; 0 for the next-visit model
+    uint64_t samples;
+} sim;
+static inline uint32_t rec_us(size_t i) {
+    return (uint32_t)((uint64_t)sim.recs[i].tick * 1000 / sim.hz) * 1000U;
+}
+static inline Rssi rec_rssi(size_t i) { return sim.recs[i].rssi * (1 << (RSSI_Q - 1)); }
+static Rssi sim_rssi(void* ctx) {
+    (void)ctx;
+    sim.samples++;
+    if(sim.sub_end) {
+        // The latest logged read at the current time; none past the last
+        while(sim.cur + 1 < sim.sub_end && (int32_t)(rec_us(sim.cur + 1) - sim.us) <= 0) sim.cur++;
+        if((int32_t)(sim.us - rec_us(sim.sub_end - 1)) > (int32_t)(1000000 / sim.hz)) return INT16_MIN;
+        return rec_rssi(sim.cur);
+    }
+    if(sim.cur != REC_NONE) sim.cur = sim.next[sim.cur];
+    return sim.cur != REC_NONE ? rec_rssi(sim.cur) : INT16_MIN;
+}
+static uint32_t sim_stamp(void* ctx) { (void)ctx; return sim.us; }
+static void sim_wait(void* ctx, uint32_t t0, uint32_t us) {
+    (void)ctx;
+    if((int32_t)(t0 + us - sim.us) > 0) sim.us = t0 + us;
+}
+static const DetRadio sim_radio = {sim_rssi, sim_stamp, sim_wait, NULL};
+
+typedef struct {
+    uint64_t records, span_ms, unlogged;
+    uint64_t episodes, detected, missed, latency_ms, latency_max;
+    uint64_t detections, locks, false_locks;
+} Report;
+
+// Per-channel bookkeeping of one file
+typedef struct {
+    uint32_t truth_last; // ms of the latest truth sample, 0 for none
+    uint32_t ep_start;   // ms the current truth episode started
+    uint32_t lock_check; // ms of a lock with no truth around it yet, 0 for none
+    bool ep_open;        // episode not detected yet
+    bool truth_seen;
+} Chan;
+
+static int truth_half_db = INT16_MIN; // -t, in 0.5 dB; INT16_MIN uses CAP_PEAK
+static FILE* stats_fp; // -S, written on the first pass only
+
+static CapRec* load(const char* path, CapHeader* hdr, size_t* n) {
+    FILE* fp = fopen(path, "rb");
+    if(!fp) { perror(path); return NULL; }
+    CapRec* recs = NULL;
+    if(fread(hdr, sizeof(*hdr), 1, fp) != 1 || hdr->magic != CAP_MAGIC ||
+       hdr->version < 1 || hdr->version > CAP_VERSION || hdr->rec_size != sizeof(CapRec)) {
+        fprintf(stderr, "%s: not a version 1..%d capture\n", path, CAP_VERSION);
+    } else if(fseek(fp, hdr->hdr_size, SEEK_SET) == 0) {
+        size_t cap = 1 << 16;
+        recs = malloc(cap * sizeof(CapRec));
+        *n = 0;
+        size_t got;
+        while(recs && (got = fread(recs + *n, sizeof(CapRec), cap - *n, fp)) > 0) {
+            *n += got;
+            if(*n == cap) recs = realloc(recs, (cap *= 2) * sizeof(CapRec));
+        }
+    }
+    fclose(fp);
+    return recs;
+}
+
+// Seed each channel's floor from its first SEED_N quiet samples, the way
+// calibration would have: median and spread
+static void seed(const CapRec* recs, size_t n, size_t num_ch) {
+    Rssi* s = calloc(num_ch * SEED_N, sizeof(Rssi));
+    uint8_t* cnt = calloc(num_ch, 1);
+    for(size_t i=0;i<n;i++) {
+        const CapRec* r = &recs[i];
+        if(r->ch >= num_ch || cnt[r->ch] >= SEED_N || (r->flags & (CAP_PEAK | CAP_CAND | CAP_SUB))) continue;
+        s[r->ch * SEED_N + cnt[r->ch]++] = r->rssi * (1 << (RSSI_Q - 1));
+    }
+    for(size_t ch=0;ch<num_ch;ch++) {
+        Rssi* v = &s[ch * SEED_N];
+        size_t m = cnt[ch];
+        if(!m) { baseline.med[ch] = RSSI_DB(MIN_RSSI_DBM); baseline.var[ch] = 0; continue; }
+        for(size_t k=1;k<m;k++) {
+            Rssi x = v[k];
+            size_t j = k;
+            for(;j>0&&v[j-1]>x;j--) v[j] = v[j-1];
+            v[j] = x;
+        }
+        int32_t med = v[m/2], var = 0;
+        for(size_t k=0;k<m;k++) var += ((v[k]-med)*(v[k]-med)) >> RSSI_Q;
+        baseline.med[ch] = med < RSSI_DB(MIN_RSSI_DBM) ? med : RSSI_DB(MIN_RSSI_DBM); // as the app's seed
+        baseline.var[ch] = var / (int32_t)m > UINT16_MAX ? UINT16_MAX : var / (int32_t)m;
+    }
+    free(cnt);
+    free(s);
+}
+
+static void replay(const CapHeader* hdr, const CapRec* recs, size_t n, Report* rep) {
+    size_t num_ch = hdr->num_ch;
+    for(size_t i=0;i<n;i++) if(recs[i].ch >= num_ch) num_ch = recs[i].ch + 1;
+    baseline.med = calloc(num_ch, sizeof(Rssi));
+    baseline.var = calloc(num_ch, sizeof(uint16_t));
+    baseline.thr = calloc(num_ch, sizeof(Rssi));
+    Chan* chan = calloc(num_ch, sizeof(Chan));
+    ChStat* st = stats_fp ? calloc(num_ch, sizeof(ChStat)) : NULL;
+    uint32_t* freq = stats_fp ? calloc(num_ch, sizeof(uint32_t)) : NULL;
+    size_t* next = malloc(n * sizeof(size_t));
+    size_t* last = malloc(num_ch * sizeof(size_t));
+    for(size_t ch=0;ch<num_ch;ch++) last[ch] = REC_NONE;
+    for(size_t i=n;i-->0;) {
+        next[i] = last[recs[i].ch];
+        if(!(recs[i].flags & CAP_SUB)) last[recs[i].ch] = i;
+    }
+    free(last);
+    sim.recs = recs;
+    sim.next = next;
+    seed(recs, n, num_ch);
+    det_rethr(num_ch);
+    det_init(&sim_radio);
+    uint32_t hz = sim.hz = hdr->tick_hz ? hdr->tick_hz : 1000;
+
+    uint32_t now = 0;
+    for(size_t i=0;i<n;i++) {
+        const CapRec* r = &recs[i];
+        if(r->flags & CAP_SUB) continue;
+        rep->records++;
+        Chan* c = &chan[r->ch];
+        now = (uint64_t)r->tick * 1000 / hz;
+        sim.us = now * 1000U;
+
+        bool truth = truth_half_db == INT16_MIN ? (r->flags & CAP_PEAK) : r->rssi >= truth_half_db;
+        if(c->ep_open && now - c->truth_last > det.hold_ms) { c->ep_open = false; rep->missed++; }
+        if(c->lock_check && now - c->lock_check > det.hold_ms) { c->lock_check = 0; rep->false_locks++; }
+        if(truth) {
+            if(!c->truth_seen || now - c->truth_last > det.hold_ms) {
+                rep->episodes++;
+                c->ep_start = now;
+                c->ep_open = true;
+            }
+            c->truth_last = now;
+            c->truth_seen = true;
+            c->lock_check = 0;
+        }
+
+        // The app's scan visit, with dwell reduced to one confirmation
+        tgt_expire(now);
+        int t = tgt_find(r->ch);
+        Rssi r0 = rec_rssi(i);
+        sim.cur = i;
+        sim.sub_end = 0;
+        sim.samples++;
+        Rssi thr = chan_thr(r->ch);
+        bool cand;
+        if(t >= 0) {
+            thr = tgt_thr(r->ch);
+            cand = r0 > thr;
+        } else {
+            cand = r0 > thr - RSSI_DB(PRE_DB);
+        }
+        if(cand) {
+            // Reads the device logged for this visit sit right before it;
+            // a new carrier confirms from the first that would have ended
+            // the dwell, a target revisit from the first
+            size_t a = i;
+            while(a && (recs[a-1].flags & CAP_SUB) && recs[a-1].ch == r->ch) a--;
+            if(a < i) {
+                while(t < 0 && a + 1 < i && rec_rssi(a) <= thr) a++;
+                sim.cur = a;
+                sim.sub_end = i;
+                sim.us = rec_us(a);
+            } else rep->unlogged++;
+        }
+        bool pk = cand && confirmed(confirm(thr, CONFIRM_M));
+        if(!pk && t < 0) floor_update(r->ch, r0);
+        if(st) {
+            stat_add(&st[r->ch], r0, pk, now);
+            freq[r->ch] = r->freq;
+        }
+        if(!pk) continue;
+        rep->detections++;
+        if(tgt_hit(r->ch, r0, now)) {
+            rep->locks++;
+            if(!c->truth_seen || now - c->truth_last > det.hold_ms) c->lock_check = now ? now : 1;
+        }
+        if(c->ep_open) {
+            uint32_t lat = now - c->ep_start;
+            c->ep_open = false;
+            rep->detected++;
+            rep->latency_ms += lat;
+            if(lat > rep->latency_max) rep->latency_max = lat;
+        }
+    }
+    for(size_t ch=0;ch<num_ch;ch++) {
+        if(chan[ch].ep_open) rep->missed++;
+        if(chan[ch].lock_check) rep->false_locks++;
+    }
+    if(n) rep->span_ms += (uint64_t)(recs[n-1].tick - recs[0].tick) * 1000 / hz;
+    if(st) {
+        char line[96];
+        for(size_t ch=0;ch<num_ch;ch++)
+            if(st[ch].n && stat_csv(line, sizeof(line), freq[ch], &st[ch]) > 0) fputs(line, stats_fp);
+        free(freq);
+        free(st);
+    }
+    free(next);
+    free(chan);
+    free(baseline.thr);
+    free(baseline.var);
+    free(baseline.med);
+}
+
+static double secs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(int argc, char** argv) {
+    int repeat = 1, opt;
+    const char* stats_path = NULL;
+    while((opt = getopt(argc, argv, "s:T:d:H:t:n:S:")) != -1) {
+        switch(opt) {
+            case 's': det.sens = atoi(optarg); break;
+            case 'T': det.thresh_db = atoi(optarg); break;
+            case 'd': det.tgt_drop_db = atoi(optarg); break;
+            case 'H': det.hold_ms = strtoul(optarg, NULL, 10); break;
+            case 't': truth_half_db = atoi(optarg) * 2; break;
+            case 'n': repeat = atoi(optarg); break;
+            case 'S': stats_path = optarg; break;
+            default:
+                fprintf(stderr, "usage: %s [-s sens] [-T thresh_db] [-d drop_db] [-H hold_ms] "
+                                "[-t truth_dbm] [-n repeat] [-S stats.csv] capture.bin...\n", argv[0]);
+                return 2;
+        }
+    }
+    if(optind >= argc || det.sens < 1 || det.sens > 5 || repeat < 1) {
+        fprintf(stderr, "need at least one capture file, sens 1..5, repeat >= 1\n");
+        return 2;
+    }
+
+    int files = argc - optind;
+    CapHeader* hdr = calloc(files, sizeof(CapHeader));
+    CapRec** recs = calloc(files, sizeof(CapRec*));
+    size_t* n = calloc(files, sizeof(size_t));
+    for(int k=0;k<files;k++)
+        if(!(recs[k] = load(argv[optind + k], &hdr[k], &n[k]))) return 1;
+
+    if(stats_path) {
+        if(!(stats_fp = fopen(stats_path, "w"))) { perror(stats_path); return 1; }
+        fputs(STAT_CSV_HEAD, stats_fp);
+    }
+
+    Report rep = {0};
+    double t0 = secs();
+    for(int i=0;i<repeat;i++) {
+        memset(&rep, 0, sizeof(rep));
+        sim.samples = 0;
+        for(int k=0;k<files;k++) replay(&hdr[k], recs[k], n[k], &rep);
+        if(stats_fp) {
+            fclose(stats_fp);
+            stats_fp = NULL;
+        }
+    }
+    double wall = (secs() - t0) / repeat;
+
+    double span = rep.span_ms / 1000.0;
+    printf("files: %d  records: %llu  span: %.1f s  replay: %.4f s (%.0fx real time)\n",
+        files, (unsigned long long)rep.records, span, wall, wall > 0 ? span / wall : 0);
+    printf("params: thresh %d dB  sens %d  drop %d dB  hold %lu ms  truth %s\n",
+        det.thresh_db, det.sens, det.tgt_drop_db, (unsigned long)det.hold_ms,
+        truth_half_db == INT16_MIN ? "CAP_PEAK" : "RSSI");
+    printf("truth episodes: %llu  detected: %llu  missed: %llu\n",
+        (unsigned long long)rep.episodes, (unsigned long long)rep.detected, (unsigned long long)rep.missed);
+    printf("detection latency: mean %.0f ms  max %llu ms\n",
+        rep.detected ? (double)rep.latency_ms / rep.detected : 0, (unsigned long long)rep.latency_max);
+    printf("locks: %llu  false: %llu (%.1f%%, %.1f/h)\n",
+        (unsigned long long)rep.locks, (unsigned long long)rep.false_locks,
+        rep.locks ? 100.0 * rep.false_locks / rep.locks : 0, span > 0 ? rep.false_locks * 3600.0 / span : 0);
+    printf("confirmations without logged reads: %llu (next-visit model)\n", (unsigned long long)rep.unlogged);
+    printf("samples: %llu  per detection: %.1f\n", (unsigned long long)sim.samples,
+        rep.detections ? (double)sim.samples / rep.detections : 0);
+
+    for(int k=0;k<files;k++) free(recs[k]);
+    free(n);
+    free(recs);
+    free(hdr);
+    return 0;
+}
@@ -0,0 +1,93 @@
+// Synthetic captures for the replay tool: Gaussian noise on every channel
+// and one carrier that comes and goes, so a parameter change can be
+// checked against a known answer.
+//
+//   tetra_synth [-c channels] [-s seconds] [-f floor_dbm] [-n noise_db]
+//               [-C ch] [-L carrier_dbm] [-a on_s] [-b off_s] [-T]
+//               [-D dwell_db] [-r seed] out.bin
+//
+// One visit per millisecond, channels round robin. -T keys the carrier in
+// one TETRA slot per frame instead of continuously. With -D a visit whose
+// quick sample is dwell_db over the floor gets a dwell, as on the device:
+// DWELL_MS of CAP_SUB reads at 1 ms ahead of its record, with the sweep
+// held meanwhile. Ground truth comes from replaying with -t.
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <unistd.h>
+#include "capture.h"
+
+#define SLOT_NS  14166667ULL // 85/6 ms
+#define DWELL_MS 114         // dwell plus classification, two frames
+
+static unsigned ch_on = 10, slot;
+static double floor_dbm = -100, noise_db = 1.5, level = -60, on_s = 20, off_s = 30;
+
+static double gauss(void) {
+    double u = (rand() + 1.0) / (RAND_MAX + 2.0), v = (rand() + 1.0) / (RAND_MAX + 2.0);
+    return sqrt(-2 * log(u)) * cos(2 * M_PI * v);
+}
+// RSSI of ch at ms t, in 0.5 dB
+static int16_t sample(unsigned ch, uint32_t t) {
+    bool on = ch == ch_on && t >= on_s * 1000 && t < off_s * 1000;
+    if(on && slot) on = (uint64_t)t * 1000000ULL % (4 * SLOT_NS) < SLOT_NS;
+    return (int16_t)lround(((on ? level : floor_dbm) + noise_db * gauss()) * 2);
+}
+
+int main(int argc, char** argv) {
+    unsigned num_ch = 200, secs = 200, seed = 1;
+    double dwell_db = 0;
+    int opt;
+    while((opt = getopt(argc, argv, "c:s:f:n:C:L:a:b:TD:r:")) != -1) {
+        switch(opt) {
+            case 'c': num_ch = strtoul(optarg, NULL, 10); break;
+            case 's': secs = strtoul(optarg, NULL, 10); break;
+            case 'f': floor_dbm = atof(optarg); break;
+            case 'n': noise_db = atof(optarg); break;
+            case 'C': ch_on = strtoul(optarg, NULL, 10); break;
+            case 'L': level = atof(optarg); break;
+            case 'a': on_s = atof(optarg); break;
+            case 'b': off_s = atof(optarg); break;
+            case 'T': slot = 1; break;
+            case 'D': dwell_db = atof(optarg); break;
+            case 'r': seed = strtoul(optarg, NULL, 10); break;
+            default:
+                fprintf(stderr, "usage: %s [-c channels] [-s seconds] [-f floor_dbm] [-n noise_db] [-C ch] "
+                                "[-L carrier_dbm] [-a on_s] [-b off_s] [-T] [-D dwell_db] [-r seed] out.bin\n",
+                                argv[0]);
+                return 2;
+        }
+    }
+    if(optind != argc - 1 || !num_ch) {
+        fprintf(stderr, "need one output file and at least one channel\n");
+        return 2;
+    }
+    FILE* fp = fopen(argv[optind], "wb");
+    if(!fp) { perror(argv[optind]); return 1; }
+    srand(seed);
+    static const uint8_t zero[CAP_HDR];
+    fwrite(zero, 1, sizeof(zero), fp);
+    uint32_t n = 0, end = secs * 1000;
+    for(uint32_t t=0, v=0;t<end;t++, v++) {
+        uint16_t ch = v % num_ch;
+        uint32_t freq = 380000000U + ch * 25000U;
+        int16_t r0 = sample(ch, t);
+        if(dwell_db && r0 >= (floor_dbm + dwell_db) * 2) {
+            for(uint32_t k=1;k<=DWELL_MS;k++) {
+                CapRec s = {t + k, freq, ch, sample(ch, t + k), 0, CAP_SUB, 0};
+                fwrite(&s, sizeof(s), 1, fp);
+                n++;
+            }
+            t += DWELL_MS;
+        }
+        CapRec r = {t, freq, ch, r0, 0, 0, 0};
+        fwrite(&r, sizeof(r), 1, fp);
+        n++;
+    }
+    CapHeader hdr = {CAP_MAGIC, CAP_VERSION, CAP_HDR, sizeof(CapRec), 2, 1000, 0, num_ch, n, 0};
+    fseek(fp, 0, SEEK_SET);
+    fwrite(&hdr, sizeof(hdr), 1, fp);
+    fclose(fp);
+    return 0;
+}
@@ -0,0 +1,29 @@
+#include <stdio.h>
+#include "stats.h"
+
+void stat_add(ChStat* s, Rssi r, bool hit, uint32_t now) {
+    if(!s->n || r < s->min) s->min = r;
+    if(!s->n || r > s->max) s->max = r;
+    if(s->n < UINT32_MAX) {
+        s->n++;
+        s->sum += r >> (RSSI_Q - 1);
+    }
+    if(hit) {
+        if(s->hits < UINT16_MAX) s->hits++;
+        s->last = now;
+    }
+    int b = ((r >> RSSI_Q) - STAT_LO_DBM) / STAT_BIN_DB;
+    b = b < 0 ? 0 : b >= STAT_BINS ? STAT_BINS - 1 : b;
+    if(++s->hist[b] == UINT8_MAX)
+        for(size_t k=0;k<STAT_BINS;k++) s->hist[k] >>= 1;
+}
+Rssi stat_mean(const ChStat* s) {
+    return s->n ? (Rssi)(s->sum / s->n) * (1 << (RSSI_Q - 1)) : RSSI_DB(MIN_RSSI_DBM);
+}
+// One STAT_CSV_HEAD line; dBm rounded towards minus infinity
+int stat_csv(char* buf, size_t len, uint32_t freq, const ChStat* s) {
+    const uint8_t* h = s->hist;
+    return snprintf(buf, len, "%lu,%lu,%u,%d,%d,%d,%lu,%u,%u,%u,%u,%u,%u,%u,%u\n",
+        (unsigned long)freq, (unsigned long)s->n, s->hits, s->min >> RSSI_Q, s->max >> RSSI_Q,
+        stat_mean(s) >> RSSI_Q, (unsigned long)s->last, h[0], h[1], h[2], h[3], h[4], h[5], h[6], h[7]);
+}
@@ -0,0 +1,24 @@
+// Per-channel occupancy statistics: O(1) integer update per visit, fixed
+// size per channel. Portable like the detector core, so the replay tool
+// can produce the same table from captures.
+#pragma once
+#include "detector.h"
+
+#define STAT_BINS          8      // RSSI histogram buckets
+#define STAT_LO_DBM        -120   // bottom of the histogram, lower samples go to bucket 0
+#define STAT_BIN_DB        10     // dB per bucket, higher samples go to the last one
+#define STAT_CSV_HEAD      "freq,samples,hits,min_dbm,max_dbm,mean_dbm,last_hit_ms," \
+                           "h0,h1,h2,h3,h4,h5,h6,h7\n"
+
+typedef struct {
+    uint32_t n;        // visits
+    int64_t sum;       // RSSI sum in 0.5 dB
+    uint32_t last;     // ms of the latest hit
+    uint16_t hits;     // visits with a confirmed detection
+    Rssi min, max;
+    uint8_t hist[STAT_BINS]; // halved as a whole when a bucket fills
+} ChStat;
+
+void stat_add(ChStat* s, Rssi r, bool hit, uint32_t now);
+Rssi stat_mean(const ChStat* s);
+int stat_csv(char* buf, size_t len, uint32_t freq, const ChStat* s);
@@ -1,27 +1,51 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <stdarg.h>
+#include <math.h>
 #include <furi.h>
 #include <gui/gui.h>
 #include <gui/view_port.h>
+#include <gui/view_dispatcher.h>
+#include <gui/modules/variable_item_list.h>
 #include <notification/notification_messages.h>
 #include <notification/notification.h>
 #include <furi_hal.h>
 #include <input/input.h>
 #include <furi_hal_light.h>
-#include <furi_hal_subghz.h>
+#include <furi_hal_subghz.h>
+#include <toolbox/saved_struct.h>
+#include <storage/storage.h>
+#include <lib/drivers/cc1101.h>
+#include <lib/subghz/devices/devices.h>
+#include "detector.h"
+#include "capture.h"
+#include "stats.h"
 
-#define MIN_RSSI_DBM       -80.0f
+#define CC1101_RSSI_OFFSET 74     // RSSI register: 0.5 dB steps above -74 dBm
 #define CAL_SAMPLES        10
 #define CAL_DELAY_MS       5
-#define THRESH_DB          8
-#define SLOT_MS            14
+#define CAL_TRIM           2      // samples dropped at each end for the spread
+#define CAL_VERIFY_CH      8      // channels re-measured on a warm start
+#define CAL_VERIFY_DB      6      // drift that invalidates the cached table
+#define CAL_MAGIC          0xCA
+#define CAL_VERSION        4
+#define SCHED_SLOTS        8      // hot-list capacity
+#define SCHED_HOT          4.0f   // score that earns a revisit every frame
+#define SCHED_WARM         1.0f   // lowest score that keeps a hot-list slot
+#define SCHED_HIT          8.0f   // added by a confirmed hit
+#define SCHED_BEACON       2      // default score floor of beacon entries
+#define SCHED_TAU_MS       3000.0f // score decay time constant
+#define GAP_AVG_SHIFT      3      // revisit interval average gain, 1/8
 #define FRAME_MS           57
+#define SLOT_TAPS          3      // samples around each predicted slot centre
+#define SLOT_TAP_US        2000   // spacing of those samples
+#define TDMA_NO_PHASE      0xFF   // State.slots when no slot phase is known
 
 #define UP_START_FREQ      380000000U
 #define UP_END_FREQ        385000000U
 #define FREQ_STEP          25000U
-#define UP_NUM_CH          (((UP_END_FREQ - UP_START_FREQ) / FREQ_STEP) + 1)
 
+// Built-in plan, used and written out when there is no plan file
 static const uint32_t STATIC_FREQS[] = {
     // original static channels
     389540000U, 388790000U, 389170000U,
@@ -33,106 +57,1358 @@ static const uint32_t STATIC_FREQS[] = {
 	384437500U, 384712500U
 };
 #define STATIC_CH (sizeof(STATIC_FREQS)/sizeof(STATIC_FREQS[0]))
+#define PLAN_PATH          APP_DATA_PATH("plan.txt")
+#define PLAN_FILE_MAX      4096   // bytes of plan file read
+#define PLAN_SPECS         48     // range/beacon lines kept
+#define PLAN_MAX_CH        1024   // channels after merging
+#define PLAN_RAM_MAX       (48 * 1024) // per-channel tables, whatever the heap has
+#define PLAN_HEAP_RESERVE  (16 * 1024) // left free for threads, capture, settings
+// Coarse stage of the Free grid: widest RX filter, one point per sub-band
+#define COARSE_STEP        300000U
+#define COARSE_MAX         32     // sub-bands, one bit each in the coarse mask
+#define COARSE_NONE        0xFF   // channel outside every sub-band
+#define COARSE_CHANBW      0x00   // MDMCFG4 CHANBW_E/M = 0/0: 812 kHz
+#define NB_CHANBW          0xF0   // MDMCFG4 CHANBW_E/M = 3/3: 58 kHz
+#define NB_OFFSET          50000U // bandwidth probe offset from the carrier
+#define COARSE_DB          4      // sub-band energy over its wideband floor
+#define COARSE_FULL_EVERY  8      // every Nth sweep is a full fine sweep
 
-#define TUNE_MS            5
-#define RX_MS              5
-#define SCAN_MS            FRAME_MS    // dwell ~1 full TETRA frame (~57 ms)
+#define RX_MS              5      // settle fallback when RX state can't be read
+#define RX_WAIT_US         1000   // bound on waiting for the CC1101 to enter RX
+#define RX_ENTRY_US        100    // IDLE to RX with the synthesizer already calibrated
+#define SCAL_WAIT_US       1000   // bound on the synthesizer calibration (~720 us)
+#define FSCAL_REFRESH_MS   300000 // cached calibrations are redone after this
+#define CC1101_AUTOCAL     0x30   // MCSM0 FS_AUTOCAL
+#define RSSI_SETTLE_US     300    // RSSI filter settle once in RX
+#define SCAN_MS            FRAME_MS    // default dwell, ~1 full TETRA frame (~57 ms)
 #define POPUP_MS           2000
-#define LOCK_HOLD_MS       20000  // 20 seconds
-#define LOCK_RSSI_DROP     5.0f   // additional dB drop when locked
+#define TGT_SHOW           4      // targets on the targets screen
+#define TGT_REVISIT_MS     (2 * FRAME_MS) // revisit period of a target
+#define TRACK_SPAN         (2 * FREQ_STEP) // neighbours a target may move to
+#define TRACK_MAX          8      // neighbours sampled per check
+#define TRACK_EVERY        4      // target revisits between neighbour checks
+#define TRACK_LOST         2      // missed revisits that start a local search
+#define TRACK_HYST         3      // dB a neighbour must beat the target by
+#define DWELL_POLL_MS      1      // burst watch interval during a dwell
+#define CC1101_IOCFG_CS    0x0E   // GDOx_CFG: carrier sense
+#define CC1101_CS_ABS_OFF  0x08   // CARRIER_SENSE_ABS_THR disabled
+#define WORKER_STACK       2048
+#define QUEUE_LEN          16
+#define SCAN_BATCH         8      // quick samples pipelined per batch
+#define CAL_BLOCK          32     // channels calibrated round-robin at once
+#define UI_POLL_MS         100    // UI wakeup when idle, expires popups
+#define UI_FRAME_MS        66     // redraw cap, ~15 fps
+#define WF_W               128    // waterfall columns across the mode's span
+#define WF_ROWS            48     // waterfall history, one row per sweep
+#define WF_Y               16     // waterfall top on screen
+#define WF_DB              10     // dB per shade step above MIN_RSSI_DBM
+#define WF_EMPTY           INT8_MIN // column with no channel visited
+#define BENCH_N            100    // samples per benchmark item
+#define BENCH_SWEEPS       8      // quick sweeps timed per plan
+#define BENCH_PATH         APP_DATA_PATH("bench.csv")
+#define STAT_SHOW          4      // channels on the stats screen
+#define STAT_PATH          APP_DATA_PATH("stats.csv")
+#define SET_PATH           APP_DATA_PATH("settings.bin")
+#define SET_MAGIC          0x5E
+#define SET_VERSION        2
+#define CAP_RING           1024   // capture records buffered in RAM
+#define CAP_CHUNK          256    // records per SD write (4 KiB)
+#define CAP_STACK          1024
+#define CAP_POLL_MS        50     // writer wakeup while less than a chunk is queued
+#define LP_GAP_MIN_MS      250    // radio sleep after the first quiet sweep
+#define LP_GAP_MAX_MS      8000   // longest sleep, doubled per quiet sweep
+#define LP_SLICE_MS        50     // sleep granularity, to notice exit/benchmark
+#define LP_DIM_MS          15000  // no input for this long turns the backlight off
+#define LP_UI_POLL_MS      1000   // UI wakeup while dark
+#define ASSIST_DEVICE      "cc1101_ext"
+#define ASSIST_PRESET      FuriHalSubGhzPreset2FSKDev238Async
+#define ASSIST_STACK       1024
+#define ASSIST_QUEUE       64     // quick samples in flight to the worker
+#define ASSIST_PUT_MS      50     // queue full: retry interval, to notice a stop
+#define ASSIST_CAL         32     // samples that set the second radio's offset
+#define ASSIST_CAL_DB      10     // per-sample clamp on that offset
 
 // Application modes
 typedef enum { OFF, ONCE, REP8, REP12, REP3, REP6 } AlertMode;
 static AlertMode mode = ONCE;
 static const char* mode_names[] = {"Off","Once","8s","12s","3s","6s"};
-static bool free_scan = false;
-static const char* scan_names[] = {"Static","Free"};
+typedef enum { ScanStatic, ScanFree, ScanHybrid, ScanModes } ScanMode;
+static ScanMode scan_mode = ScanStatic;
+static const char* scan_names[] = {"Static","Free","Hybrid"};
+typedef enum { ScreenMain, ScreenWaterfall, ScreenTargets, ScreenStats, ScreenBench, Screens } Screen;
 static bool debug = false;
 static bool tdma = false;
-static int sens = 3;
+static bool cs_irq = true; // dwell sleeps on CC1101 carrier sense instead of polling
+static bool coarse = true; // coarse-to-fine sweeps of the Free grid
+static Screen screen = ScreenMain;
+static bool bench_log = true; // append benchmark results to bench.csv
 
-// Lock state
-static bool locked = false;
-static uint32_t lock_start = 0;
+static bool track = true; // follow a target's carrier to an adjacent channel
+static bool low_power = false; // sleep the radio between quiet sweeps, dim the display
+static uint32_t dwell_ms = SCAN_MS; // candidate dwell
+static uint32_t settle_us = RSSI_SETTLE_US;
+static volatile bool rethr_req; // thresh_db changed, worker rebuilds the threshold table
+static volatile bool ui_dark; // backlight off: no redraws, worker posts only alerts
+static bool dual = false; // second CC1101 sweeps half the plan
+static volatile bool assist_missing; // dual asked for, no module answered
+
+// Channel plan: the plan file's ranges and beacons merged, deduplicated
+// and sorted by frequency once at startup. A channel index is the same in
+// every mode, so each channel has exactly one baseline slot. All per-channel
+// tables live in one block sized to the plan.
+#define CH_GRID            1
+#define CH_BEACON          2
+#define CH_ASSIST          4      // swept by the second radio
+static uint32_t* ch_freq;
+static uint32_t* ch_fw; // FREQ2..0 register word per channel
+// Synthesizer calibration result for one frequency, valid while epoch
+// matches fscal_epoch
+typedef struct { uint8_t fscal[3]; uint8_t epoch; } FsCal;
+static FsCal* ch_cal;
+static ChStat* ch_stat; // since launch, exported to STAT_PATH on exit
+static uint8_t fscal_epoch = 1;
+static uint32_t fscal_at;
+static uint8_t* ch_flags;
+static uint8_t* ch_prio;  // scheduler score floor
+static uint8_t* ch_bin;   // coarse sub-band
+static size_t num_ch;
+static const uint8_t mode_mask[ScanModes] = {CH_BEACON, CH_GRID, CH_GRID|CH_BEACON};
+static uint16_t* plan[ScanModes];
+static size_t plan_len[ScanModes];
+static void* plan_mem;
+
+// Radio tuning layer: what the CC1101 is currently doing
+typedef enum { RadioIdle, RadioRx, RadioSleep } RadioState;
+static struct {
+    uint32_t freq;
+    RadioState state;
+    uint32_t srx;  // cycle stamp of the last SRX
+    bool settling; // SRX issued, settle not waited for yet
+} radio = {0, RadioIdle, 0, false};
 
 // State
-static float baseline[UP_NUM_CH];
+typedef struct {
+    Rssi r; uint32_t f; bool p; bool l; bool c; uint8_t slots; uint32_t sw;
+    uint16_t gap_avg, gap_max; // revisit interval of channel f, ms
+} State;
+typedef struct {
+    Target t[TGT_SHOW]; // strongest first
+    uint8_t n;
+} TargetList;
+typedef struct {
+    uint16_t ch[STAT_SHOW]; // most hits first, then loudest
+    ChStat s[STAT_SHOW];
+    uint8_t n;
+} StatList;
+// Benchmark results, in microseconds
+typedef enum {
+    BenchSetFreq, BenchSettle, BenchRssi, BenchConfirm,
+    BenchSweepStatic, BenchSweepFree, BenchRedraw, BenchItems
+} BenchItem;
+static const char* bench_names[BenchItems] = {"SetFreq","Settle","RSSI","Confirm","SweepS","SweepF","Redraw"};
+typedef struct { uint32_t min, mean, p99; } BenchStat;
+typedef struct {
+    BenchStat s[BenchItems];
+    bool done;
+} BenchResult;
+static bool baseline_valid = false;
 static NotificationApp* notif;
-static char popup[32];
-static uint32_t popup_until;
+
+// Scheduler state: activity score, last visit and revisit interval
+// statistics per channel, plus a hot list of the highest-scoring channels
+typedef struct {
+    float* score;
+    uint32_t* last;
+    uint16_t* gap_avg; // ms, running average
+    uint16_t* gap_max; // ms, saturating
+    uint16_t hot[SCHED_SLOTS];
+    size_t nhot;
+    const uint16_t* plan; // plan being swept
+    uint16_t* list; // plan narrowed by the coarse stage
+    size_t cnt, cursor;
+    size_t base;   // plan index the sweep started at
+    size_t resume; // channel the next cursor visit starts from
+    uint8_t mask;
+    bool hot_turn;
+} Sched;
+static Sched sched;
+
+// Everything render() shows. The UI thread edits a private copy and
+// publishes it here; render() copies it out under the mutex, so it never
+// sees a half-written scan result.
+typedef struct {
+    State scan;
+    ScanMode scan_mode;
+    bool debug;
+    bool tdma;
+    Screen screen;
+    TargetList targets;
+    StatList stats;
+    BenchResult bench;
+    bool cap;
+    uint32_t cap_drop;
+    char popup[32];
+    uint32_t popup_until;
+} Snapshot;
+static Snapshot snap;
+static FuriMutex* snap_mutex;
+
+// Events drained by the UI thread; scan results come from the radio worker
+typedef enum { EvInput, EvScan, EvAlert, EvTargets, EvStats, EvBench } EventType;
+typedef struct {
+    EventType type;
+    union {
+        InputEvent input;
+        State scan;
+        TargetList targets;
+        StatList stats;
+        BenchResult bench;
+    };
+} Event;
+static FuriMessageQueue* queue;
+static volatile bool running;
+static volatile bool bench_req; // UI asks the worker for a benchmark run
+// render() cost, in CPU cycles, kept by the GUI thread for the benchmark
+static uint32_t redraw_cyc[BENCH_N];
+static uint32_t redraw_n;
 
 // Helpers
 static inline uint32_t ticks(uint32_t ms) { return furi_ms_to_ticks(ms); }
-static inline float read_rssi(uint32_t freq) {
+static inline uint32_t tick_ms(uint32_t t) { return t * 1000U / furi_kernel_get_tick_frequency(); }
+static inline uint32_t cyc(void) { return DWT->CYCCNT; }
+// Wait until `us` after cycle stamp t0: whole milliseconds are slept
+// through the scheduler, only the sub-millisecond tail is spun
+static void wait_until(uint32_t t0, uint32_t us) {
+    int32_t ipus = furi_hal_cortex_instructions_per_microsecond();
+    uint32_t deadline = t0 + us * ipus;
+    int32_t left = (int32_t)(deadline - cyc()) / ipus;
+    if(left >= 1000) furi_delay_ms(left / 1000);
+    left = (int32_t)(deadline - cyc()) / ipus;
+    if(left > 0) furi_delay_us(left);
+}
+static inline uint32_t chan_freq(size_t ch) { return ch_freq[ch]; }
+// FREQ2..0 for f, truncated like cc1101_set_frequency
+static inline uint32_t freq_word(uint32_t f) { return ((uint64_t)f << 16) / CC1101_QUARTZ; }
+static void radio_write_reg(uint8_t reg, uint8_t val) {
+    furi_hal_spi_acquire(&furi_hal_spi_bus_handle_subghz);
+    cc1101_write_reg(&furi_hal_spi_bus_handle_subghz, reg, val);
+    furi_hal_spi_release(&furi_hal_spi_bus_handle_subghz);
+}
+static uint8_t radio_read_reg(uint8_t reg) {
+    uint8_t val = 0;
+    furi_hal_spi_acquire(&furi_hal_spi_bus_handle_subghz);
+    cc1101_read_reg(&furi_hal_spi_bus_handle_subghz, reg, &val);
+    furi_hal_spi_release(&furi_hal_spi_bus_handle_subghz);
+    return val;
+}
+// Carrier-sense backend: GDO0 is switched to the CC1101 carrier-sense
+// output and its rising edge releases cs_sem, so a dwell can sleep until
+// the radio itself sees energy
+static FuriSemaphore* cs_sem; // non-NULL while carrier sense is set up
+static uint8_t cs_saved_iocfg0, cs_saved_agcctrl1;
+static void cs_route(void) {
+    radio_write_reg(CC1101_IOCFG0, CC1101_IOCFG_CS);
+    furi_hal_gpio_init(&gpio_cc1101_g0, GpioModeInterruptRise, GpioPullNo, GpioSpeedLow);
+}
+// SLEEP keeps the configuration but loses TEST2..0, which set the RX
+// sensitivity; they are saved here and written back on wake
+static const uint8_t radio_test_regs[] = {CC1101_TEST2, CC1101_TEST1, CC1101_TEST0};
+static uint8_t radio_test[COUNT_OF(radio_test_regs)];
+static void radio_sleep(void) {
+    if(radio.state == RadioSleep) return;
+    for(size_t i=0;i<COUNT_OF(radio_test_regs);i++) radio_test[i] = radio_read_reg(radio_test_regs[i]);
+    furi_hal_subghz_sleep();
+    radio.state = RadioSleep;
+    radio.settling = false;
+}
+// Any SPI access wakes the chip; the strobe waits for the crystal.
+// The HAL's sleep also parks GDO0, so carrier sense is routed again.
+static void radio_wake(void) {
+    furi_hal_subghz_idle();
+    for(size_t i=0;i<COUNT_OF(radio_test_regs);i++) radio_write_reg(radio_test_regs[i], radio_test[i]);
+    if(cs_sem) cs_route();
+    radio.state = RadioIdle;
+}
+static void radio_rx(void) {
+    furi_hal_subghz_rx();
+    radio.srx = cyc();
+    radio.settling = true;
+}
+// After SRX wait for the CC1101 to report RX (PLL locked) and for the
+// RSSI filter to have had settle_us since, instead of a blind RX_MS
+// sleep. Time spent elsewhere since the SRX counts towards it.
+static void radio_settle(void) {
+    if(!radio.settling) return;
+    radio.settling = false;
+    furi_hal_spi_acquire(&furi_hal_spi_bus_handle_subghz);
+    bool rx = cc1101_wait_status_state(&furi_hal_spi_bus_handle_subghz, CC1101StateRX, RX_WAIT_US);
+    furi_hal_spi_release(&furi_hal_spi_bus_handle_subghz);
+    if(rx) wait_until(radio.srx, RX_ENTRY_US + settle_us);
+    else furi_delay_ms(RX_MS);
+}
+// Retune from a precomputed register word, no division per channel.
+// With a valid cached calibration that is six register writes; otherwise
+// the synthesizer is calibrated once and the result kept in cal.
+// Expects IDLE.
+static const uint8_t fscal_regs[] = {CC1101_FSCAL3, CC1101_FSCAL2, CC1101_FSCAL1};
+static void radio_set_word(uint32_t fw, FsCal* cal) {
+    FuriHalSpiBusHandle* h = &furi_hal_spi_bus_handle_subghz;
+    furi_hal_spi_acquire(h);
+    cc1101_write_reg(h, CC1101_FREQ2, fw >> 16);
+    cc1101_write_reg(h, CC1101_FREQ1, fw >> 8);
+    cc1101_write_reg(h, CC1101_FREQ0, fw);
+    if(cal->epoch == fscal_epoch) {
+        for(size_t i=0;i<COUNT_OF(fscal_regs);i++) cc1101_write_reg(h, fscal_regs[i], cal->fscal[i]);
+    } else {
+        cc1101_calibrate(h);
+        cc1101_wait_status_state(h, CC1101StateIDLE, SCAL_WAIT_US);
+        for(size_t i=0;i<COUNT_OF(fscal_regs);i++) cc1101_read_reg(h, fscal_regs[i], &cal->fscal[i]);
+        cal->epoch = fscal_epoch;
+    }
+    furi_hal_spi_release(h);
+}
+// Tuning programs the synthesizer itself, so SRX must not recalibrate
+static uint8_t fast_saved_mcsm0;
+static void fast_begin(void) {
+    fast_saved_mcsm0 = radio_read_reg(CC1101_MCSM0);
+    radio_write_reg(CC1101_MCSM0, fast_saved_mcsm0 & ~CC1101_AUTOCAL);
+    fscal_at = furi_get_tick();
+}
+static void fast_end(void) {
+    radio_write_reg(CC1101_MCSM0, fast_saved_mcsm0);
+}
+// Retune and strobe RX without waiting for it to settle; a no-op when
+// already receiving on freq
+static void radio_tune_start(uint32_t freq, uint32_t fw, FsCal* cal) {
+    if(radio.state == RadioRx && radio.freq == freq) return;
+    if(radio.state == RadioSleep) radio_wake();
     furi_hal_subghz_idle();
-    furi_hal_subghz_set_frequency(freq);
-    furi_delay_ms(RX_MS);
-    return furi_hal_subghz_get_rssi();
+    radio_set_word(fw, cal);
+    radio_rx();
+    radio.freq = freq;
+    radio.state = RadioRx;
 }
-static bool persist(float threshold) {
-    uint32_t end = furi_get_tick() + ticks(SLOT_MS);
+static void radio_tune(uint32_t freq, uint32_t fw, FsCal* cal) {
+    radio_tune_start(freq, fw, cal);
+    radio_settle();
+}
+static void radio_idle(void) {
+    if(radio.state == RadioSleep) radio_wake();
+    furi_hal_subghz_idle();
+    radio.state = RadioIdle;
+    radio.settling = false;
+}
+// Current RSSI straight from the CC1101 status register, no float
+// conversion on the way
+static inline Rssi rssi_now(void) {
+    furi_hal_spi_acquire(&furi_hal_spi_bus_handle_subghz);
+    int8_t raw = cc1101_get_rssi(&furi_hal_spi_bus_handle_subghz);
+    furi_hal_spi_release(&furi_hal_spi_bus_handle_subghz);
+    return (raw - 2*CC1101_RSSI_OFFSET) * (1 << (RSSI_Q - 1));
+}
+static inline void tune_ch(size_t ch) { radio_tune(ch_freq[ch], ch_fw[ch], &ch_cal[ch]); }
+static inline Rssi read_ch(size_t ch) {
+    tune_ch(ch);
+    return rssi_now();
+}
+// Batched quick samples: the retune to chs[i+1] is issued as soon as
+// chs[i] is read, and eval(i) runs while it settles, so per-channel CPU
+// work overlaps the radio's settle time. eval must not use the radio.
+typedef void (*SampleEval)(size_t i, Rssi r, void* ctx);
+static void sample_channels(const uint16_t* chs, size_t n, Rssi* out, SampleEval eval, void* ctx) {
+    if(!n) return;
+    radio_tune_start(ch_freq[chs[0]], ch_fw[chs[0]], &ch_cal[chs[0]]);
+    for(size_t i=0;i<n;i++) {
+        radio_settle();
+        Rssi r = rssi_now();
+        if(out) out[i] = r;
+        if(i+1 < n) radio_tune_start(ch_freq[chs[i+1]], ch_fw[chs[i+1]], &ch_cal[chs[i+1]]);
+        if(eval) eval(i, r, ctx);
+    }
+}
+// Capture log: the worker appends fixed-size records (capture.h) to a RAM
+// ring and a low-priority writer thread flushes it to SD in CAP_CHUNK
+// blocks, so the scan loop never waits on storage. When the ring is full
+// records are dropped and counted.
+_Static_assert(CAP_RING % CAP_CHUNK == 0, "chunks must not wrap the ring");
+static struct {
+    CapRec ring[CAP_RING];
+    uint32_t head;      // written by the worker only
+    uint32_t tail;      // written by the writer only
+    uint32_t drop_full; // worker: ring full
+    uint32_t drop_io;   // writer: short SD write
+    uint32_t records;
+    bool on;
+    Storage* storage;
+    File* file;
+    FuriThread* thread;
+    uint16_t sub_ch;    // channel of the visit in progress
+} cap;
+
+static void cap_log(size_t ch, Rssi r, Rssi thr, uint8_t flags) {
+    if(!__atomic_load_n(&cap.on, __ATOMIC_ACQUIRE)) return;
+    uint32_t h = cap.head;
+    if(h - __atomic_load_n(&cap.tail, __ATOMIC_ACQUIRE) >= CAP_RING) { cap.drop_full++; return; }
+    cap.ring[h % CAP_RING] = (CapRec){
+        furi_get_tick(), chan_freq(ch), ch, r >> (RSSI_Q - 1), thr >> (RSSI_Q - 1), flags, 0};
+    __atomic_store_n(&cap.head, h + 1, __ATOMIC_RELEASE);
+}
+// Dwell, confirmation and slot reads of the visit in progress go to the
+// capture too (CAP_SUB, ahead of the visit record), so the replay can
+// confirm from the device's own samples rather than from later sweeps
+static Rssi rssi_logged(void) {
+    Rssi r = rssi_now();
+    cap_log(cap.sub_ch, r, 0, CAP_SUB);
+    return r;
+}
+// What the detector core samples through
+static Rssi det_rssi(void* ctx) { UNUSED(ctx); return rssi_logged(); }
+static uint32_t det_stamp(void* ctx) { UNUSED(ctx); return cyc(); }
+static void det_wait(void* ctx, uint32_t t0, uint32_t us) { UNUSED(ctx); wait_until(t0, us); }
+static const DetRadio cc1101_det = {det_rssi, det_stamp, det_wait, NULL};
+
+// TDMA: slot phase of the carrier on one channel, as the cycle stamp of
+// the start of the slot its burst was found in (slot 0). Each target keeps
+// its own; the spare entry is for the candidate being acquired.
+typedef struct {
+    size_t ch;
+    uint32_t ref;
+    bool valid;
+    uint8_t occ;
+} TdmaPhase;
+static TdmaPhase tdma_ph[TGT_MAX + 1];
+// ch's entry, else one not held by a target
+static TdmaPhase* tdma_entry(size_t ch) {
+    TdmaPhase* free_ph = &tdma_ph[0];
+    for(size_t k=0;k<COUNT_OF(tdma_ph);k++) {
+        if(tdma_ph[k].ch == ch) return &tdma_ph[k];
+        if(!tdma_ph[k].valid || tgt_find(tdma_ph[k].ch) < 0) free_ph = &tdma_ph[k];
+    }
+    free_ph->ch = ch;
+    free_ph->valid = false;
+    return free_ph;
+}
+// Phase from a classify() envelope: slot 0 starts si->phase steps into
+// it. A continuous carrier fills every slot at any phase.
+static bool tdma_set(size_t ch, const SigInfo* si) {
+    TdmaPhase* ph = tdma_entry(ch);
+    ph->valid = si->cls == SigTdma || si->cls == SigCont;
+    ph->ref = si->t0 + si->phase * ENV_STEP_US * furi_hal_cortex_instructions_per_microsecond();
+    ph->occ = si->cls == SigTdma ? si->occ : 0x0F;
+    return ph->valid;
+}
+static bool tdma_acquire(size_t ch, Rssi threshold) {
+    SigInfo si = classify(threshold);
+    return tdma_set(ch, &si);
+}
+// Sample only the predicted slot centres of the next frame; returns the
+// occupancy mask, bit k set when slot k is busy
+static uint8_t tdma_slots(size_t ch, Rssi threshold) {
+    TdmaPhase* ph = tdma_entry(ch);
+    uint32_t frame = FRAME_US * furi_hal_cortex_instructions_per_microsecond();
+    uint32_t start = ph->ref + ((cyc() - ph->ref) / frame + 1) * frame;
+    uint8_t occ = 0;
+    for(size_t s=0;s<4;s++) {
+        uint8_t hits = 0;
+        for(size_t t=0;t<SLOT_TAPS;t++) {
+            int32_t off = ((int32_t)t - SLOT_TAPS/2) * SLOT_TAP_US;
+            wait_until(start, s*SLOT_US + SLOT_US/2 + off);
+            hits += rssi_logged() >= threshold;
+        }
+        if(hits*2 > SLOT_TAPS) occ |= 1 << s;
+    }
+    // Re-anchor on this frame so the stamp never ages past a counter wrap
+    ph->ref = start;
+    ph->occ = occ;
+    if(!occ) ph->valid = false;
+    return occ;
+}
+static uint8_t tdma_report(size_t ch) {
+    for(size_t k=0;k<COUNT_OF(tdma_ph);k++)
+        if(tdma_ph[k].valid && tdma_ph[k].ch == ch) return tdma_ph[k].occ;
+    return TDMA_NO_PHASE;
+}
+static void cs_isr(void* ctx) {
+    UNUSED(ctx);
+    furi_semaphore_release(cs_sem);
+}
+static void cs_begin(void) {
+    cs_sem = furi_semaphore_alloc(1, 0);
+    cs_saved_iocfg0 = radio_read_reg(CC1101_IOCFG0);
+    cs_saved_agcctrl1 = radio_read_reg(CC1101_AGCCTRL1);
+    cs_route();
+    furi_hal_gpio_add_int_callback(&gpio_cc1101_g0, cs_isr, NULL);
+}
+static void cs_end(void) {
+    furi_hal_gpio_remove_int_callback(&gpio_cc1101_g0);
+    furi_hal_gpio_init(&gpio_cc1101_g0, GpioModeAnalog, GpioPullNo, GpioSpeedLow);
+    radio_write_reg(CC1101_IOCFG0, cs_saved_iocfg0);
+    radio_write_reg(CC1101_AGCCTRL1, cs_saved_agcctrl1);
+    furi_semaphore_free(cs_sem);
+}
+// The CC1101 only offers a +6/+10/+14 dB carrier-sense step relative to
+// the level at RX entry, so pick the step nearest below the channel's
+// margin over its floor; software re-checks the exact thr on wakeup
+static void cs_arm(size_t ch, Rssi threshold) {
+    int32_t base = baseline.med[ch] < RSSI_DB(MIN_RSSI_DBM) ? baseline.med[ch] : RSSI_DB(MIN_RSSI_DBM);
+    int32_t margin = threshold - base;
+    uint8_t rel = margin < RSSI_DB(10) ? 1 : margin < RSSI_DB(14) ? 2 : 3;
+    radio_write_reg(CC1101_AGCCTRL1, (cs_saved_agcctrl1 & 0x40) | (rel << 4) | CC1101_CS_ABS_OFF);
+    while(furi_semaphore_acquire(cs_sem, 0) == FuriStatusOk) {} // edges from before arming
+}
+
+// Frame-length dwell on a candidate channel: watch for a burst above thr,
+// then confirm it over a slot; in TDMA mode accept() classifies it instead
+static bool dwell(size_t ch, Rssi threshold) {
+    uint32_t end = furi_get_tick() + ticks(dwell_ms);
+    bool cs = cs_irq;
+    if(cs) cs_arm(ch, threshold);
     while(furi_get_tick() < end) {
-        if(furi_hal_subghz_get_rssi() < threshold) return false;
+        if(rssi_logged() > threshold) {
+            // TDMA: accept()'s classification is the confirmation, and
+            // its envelope also gives the slot phase
+            if(tdma) return true;
+            if(confirmed(confirm(threshold, CONFIRM_M))) return true;
+        } else if(cs && !furi_hal_gpio_read(&gpio_cc1101_g0)) {
+            // Sleep until carrier sense fires or the dwell runs out
+            int32_t left = (int32_t)(end - furi_get_tick());
+            if(left > 0) furi_semaphore_acquire(cs_sem, left);
+        } else {
+            furi_delay_ms(DWELL_POLL_MS);
+        }
+    }
+    return false;
+}
+
+// Occupied bandwidth: with the RX filter at 58 kHz a 25 kHz TETRA carrier
+// is gone NB_OFFSET away, so a neighbour within CLS_NB_DB of the carrier
+// means something wider. A TDMA carrier is probed inside its first busy
+// slot, the carrier itself first so all three see the same burst.
+static bool narrowband(size_t ch, const SigInfo* si) {
+    if(si->cls == SigTdma) {
+        uint32_t ipus = furi_hal_cortex_instructions_per_microsecond();
+        uint32_t at = si->phase * ENV_STEP_US + __builtin_ctz(si->occ) * SLOT_US + SLOT_US / 8;
+        uint32_t since = (cyc() - si->t0) / ipus;
+        if(at < since) at += ((since - at) / FRAME_US + 1) * FRAME_US;
+        wait_until(si->t0, at);
+    }
+    radio_idle();
+    uint8_t mdm = radio_read_reg(CC1101_MDMCFG4);
+    radio_write_reg(CC1101_MDMCFG4, (mdm & 0x0F) | NB_CHANBW);
+    Rssi lim = read_ch(ch) - RSSI_DB(CLS_NB_DB);
+    bool narrow = true;
+    for(int d=-1;d<=1&&narrow;d+=2) {
+        FsCal cal = {{0}, 0}; // off-plan, calibrated on the spot
+        uint32_t nf = chan_freq(ch) + d * (int32_t)NB_OFFSET;
+        radio_tune(nf, freq_word(nf), &cal);
+        narrow = rssi_now() < lim;
+    }
+    radio_idle();
+    radio_write_reg(CC1101_MDMCFG4, mdm);
+    return narrow;
+}
+// Lock gate for a new carrier that passed the dwell: classify it and
+// only commit on a confident match; anything else is kept out of the
+// dwell for REJ_HOLD_MS
+static bool accept(size_t ch, Rssi threshold, uint32_t now) {
+    SigInfo si = classify(threshold);
+    tdma_set(ch, &si);
+    if(si.cls == SigNone) return false;
+    if(sig_accept(&si, ch_flags[ch] & CH_BEACON) && narrowband(ch, &si)) return true;
+    det_reject(ch, now);
+    return false;
+}
+
+// Coarse stage: with the RX filter opened to 812 kHz one sample covers a
+// whole COARSE_STEP sub-band of a plan range. Each sub-band keeps its own
+// wideband floor, tracked like the per-channel one. Returns a mask of
+// sub-bands with energy.
+static struct {
+    uint32_t freq[COARSE_MAX];
+    uint32_t fw[COARSE_MAX];
+    FsCal cal[COARSE_MAX];
+    Rssi floor[COARSE_MAX];
+    size_t n;
+    bool init;
+} coarse_st;
+// Drop every cached calibration, so drift with temperature is picked up
+static void fscal_refresh(void) {
+    if(++fscal_epoch == 0) {
+        memset(ch_cal, 0, num_ch * sizeof(FsCal));
+        memset(coarse_st.cal, 0, sizeof(coarse_st.cal));
+        fscal_epoch = 1;
+    }
+    fscal_at = furi_get_tick();
+}
+static uint32_t coarse_pass(void) {
+    radio_idle();
+    uint8_t mdm = radio_read_reg(CC1101_MDMCFG4);
+    radio_write_reg(CC1101_MDMCFG4, (mdm & 0x0F) | COARSE_CHANBW);
+    uint32_t bands = 0;
+    for(size_t k=0;k<coarse_st.n;k++) {
+        radio_tune(coarse_st.freq[k], coarse_st.fw[k], &coarse_st.cal[k]);
+        Rssi r = rssi_now();
+        Rssi* fl = &coarse_st.floor[k];
+        if(!coarse_st.init) *fl = r;
+        int32_t d = r - *fl;
+        if(d > RSSI_DB(COARSE_DB)) bands |= 1U << k;
+        *fl = median_step(*fl, r);
     }
+    coarse_st.init = true;
+    // Back to the narrow filter; force a full retune on the next read
+    radio_idle();
+    radio_write_reg(CC1101_MDMCFG4, mdm);
+    return bands;
+}
+
+// Plan file, one entry per line, '#' starts a comment:
+//   range <start> <end> <step> [prio]
+//   beacon <freq> [prio]
+// A frequency with a decimal point is in MHz, otherwise in Hz. prio is the
+// channel's scheduler score floor.
+typedef struct { uint32_t start, end, step; uint8_t flags, prio; } PlanSpec;
+typedef struct { uint32_t f; uint8_t flags, prio; } PlanEntry;
+static PlanSpec specs[PLAN_SPECS];
+static size_t num_specs;
+
+static const char* parse_uint(const char* p, uint32_t* v) {
+    while(*p == ' ' || *p == '\t') p++;
+    if(*p < '0' || *p > '9') return NULL;
+    for(*v = 0; *p >= '0' && *p <= '9'; p++) *v = *v*10 + (*p - '0');
+    return p;
+}
+static const char* parse_freq(const char* p, uint32_t* v) {
+    if(!(p = parse_uint(p, v))) return NULL;
+    if(*p != '.') return p;
+    uint32_t frac = 0, scale = 1000000;
+    for(p++; *p >= '0' && *p <= '9'; p++)
+        if(scale > 1) { scale /= 10; frac += (*p - '0') * scale; }
+    *v = *v * 1000000 + frac;
+    return p;
+}
+static bool keyword(const char** p, const char* kw) {
+    size_t n = strlen(kw);
+    if(strncmp(*p, kw, n) || (*p)[n] > ' ') return false;
+    *p += n;
     return true;
 }
+static void plan_parse_line(const char* p) {
+    while(*p == ' ' || *p == '\t') p++;
+    if(num_specs >= PLAN_SPECS) return;
+    PlanSpec* sp = &specs[num_specs];
+    uint32_t prio;
+    if(keyword(&p, "range")) {
+        if(!(p = parse_freq(p, &sp->start)) || !(p = parse_freq(p, &sp->end)) ||
+           !(p = parse_freq(p, &sp->step)) || !sp->step || sp->end < sp->start) return;
+        sp->flags = CH_GRID;
+        sp->prio = 0;
+    } else if(keyword(&p, "beacon")) {
+        if(!(p = parse_freq(p, &sp->start))) return;
+        sp->end = sp->start;
+        sp->step = 1;
+        sp->flags = CH_BEACON;
+        sp->prio = SCHED_BEACON;
+    } else return;
+    if(parse_uint(p, &prio)) sp->prio = prio > UINT8_MAX ? UINT8_MAX : prio;
+    num_specs++;
+}
+static void plan_default(void) {
+    num_specs = 0;
+    specs[num_specs++] = (PlanSpec){UP_START_FREQ, UP_END_FREQ, FREQ_STEP, CH_GRID, 0};
+    for(size_t k=0;k<STATIC_CH;k++)
+        specs[num_specs++] = (PlanSpec){STATIC_FREQS[k], STATIC_FREQS[k], 1, CH_BEACON, SCHED_BEACON};
+}
+// Read the plan file; without one, fall back to the built-in plan and
+// write it out as a template
+static void plan_load(void) {
+    Storage* storage = furi_record_open(RECORD_STORAGE);
+    File* file = storage_file_alloc(storage);
+    char* buf = malloc(PLAN_FILE_MAX);
+    num_specs = 0;
+    if(storage_file_open(file, PLAN_PATH, FSAM_READ, FSOM_OPEN_EXISTING)) {
+        size_t n = storage_file_read(file, buf, PLAN_FILE_MAX - 1);
+        buf[n] = 0;
+        for(char* line = buf; line && *line;) {
+            char* next = strchr(line, '\n');
+            if(next) *next++ = 0;
+            char* hash = strchr(line, '#');
+            if(hash) *hash = 0;
+            plan_parse_line(line);
+            line = next;
+        }
+    } else {
+        plan_default();
+        storage_file_close(file);
+        if(storage_file_open(file, PLAN_PATH, FSAM_WRITE, FSOM_CREATE_NEW)) {
+            int n = snprintf(buf, PLAN_FILE_MAX,
+                "# range <start> <end> <step> [prio] / beacon <freq> [prio]\n"
+                "# MHz with a decimal point, Hz otherwise\n");
+            for(size_t k=0;k<num_specs&&n<PLAN_FILE_MAX;k++) {
+                const PlanSpec* sp = &specs[k];
+                if(sp->flags & CH_GRID)
+                    n += snprintf(buf+n, PLAN_FILE_MAX-n, "range %lu %lu %lu %u\n",
+                        (unsigned long)sp->start, (unsigned long)sp->end, (unsigned long)sp->step, sp->prio);
+                else
+                    n += snprintf(buf+n, PLAN_FILE_MAX-n, "beacon %lu %u\n",
+                        (unsigned long)sp->start, sp->prio);
+            }
+            if(n > PLAN_FILE_MAX) n = PLAN_FILE_MAX;
+            storage_file_write(file, buf, n);
+        }
+    }
+    storage_file_close(file);
+    storage_file_free(file);
+    furi_record_close(RECORD_STORAGE);
+    free(buf);
+    if(!num_specs) plan_default();
+}
 
-// Input handler
+static int plan_cmp(const void* a, const void* b) {
+    uint32_t x = ((const PlanEntry*)a)->f, y = ((const PlanEntry*)b)->f;
+    return (x > y) - (x < y);
+}
+// Expand the specs, sort and merge duplicates; sorting keeps retune steps
+// between neighbours short. Every per-channel table is carved out of one
+// block, so nothing is allocated once scanning starts.
+// Bytes of the per-channel block below, per channel
+#define PLAN_CH_BYTES      (sizeof(ChStat) + sizeof(float) + 3*sizeof(uint32_t) + sizeof(FsCal) + \
+                            (ScanModes+6)*sizeof(uint16_t) + 3*sizeof(uint8_t))
+static volatile size_t plan_cut; // entries dropped to fit the heap, for the UI
+// Channels the heap can take, the merge buffer included: Flipper's malloc
+// doesn't return NULL, it stops the system
+static size_t plan_fit(void) {
+    size_t avail = memmgr_heap_get_max_free_block();
+    avail = avail > PLAN_HEAP_RESERVE ? avail - PLAN_HEAP_RESERVE : 0;
+    if(avail > PLAN_RAM_MAX) avail = PLAN_RAM_MAX;
+    return avail / (PLAN_CH_BYTES + sizeof(PlanEntry));
+}
+static void plan_build(void) {
+    size_t n = 0;
+    for(size_t k=0;k<num_specs&&n<PLAN_MAX_CH;k++) n += (specs[k].end - specs[k].start) / specs[k].step + 1;
+    if(n > PLAN_MAX_CH) n = PLAN_MAX_CH;
+    size_t fit = plan_fit();
+    if(n > fit) { plan_cut = n - fit; n = fit; }
+    PlanEntry* e = malloc(n * sizeof(PlanEntry));
+    size_t m = 0;
+    for(size_t k=0;k<num_specs;k++)
+        for(uint32_t f=specs[k].start; f<=specs[k].end && m<n; f+=specs[k].step) {
+            e[m++] = (PlanEntry){f, specs[k].flags, specs[k].prio};
+            if(specs[k].end - f < specs[k].step) break;
+        }
+    qsort(e, m, sizeof(PlanEntry), plan_cmp);
+    num_ch = 0;
+    for(size_t i=0;i<m;i++) {
+        if(num_ch && e[num_ch-1].f == e[i].f) {
+            e[num_ch-1].flags |= e[i].flags;
+            if(e[i].prio > e[num_ch-1].prio) e[num_ch-1].prio = e[i].prio;
+        } else e[num_ch++] = e[i];
+    }
+
+    size_t c = num_ch;
+    uint8_t* p = plan_mem = calloc(1, c * PLAN_CH_BYTES);
+    ch_stat = (ChStat*)p; p += c*sizeof(ChStat); // first, for its int64 alignment
+    sched.score = (float*)p; p += c*sizeof(float);
+    ch_freq = (uint32_t*)p; p += c*sizeof(uint32_t);
+    ch_fw = (uint32_t*)p; p += c*sizeof(uint32_t);
+    ch_cal = (FsCal*)p; p += c*sizeof(FsCal);
+    sched.last = (uint32_t*)p; p += c*sizeof(uint32_t);
+    baseline.med = (Rssi*)p; p += c*sizeof(Rssi);
+    baseline.var = (uint16_t*)p; p += c*sizeof(uint16_t);
+    baseline.thr = (Rssi*)p; p += c*sizeof(Rssi);
+    for(size_t k=0;k<ScanModes;k++) { plan[k] = (uint16_t*)p; p += c*sizeof(uint16_t); }
+    sched.list = (uint16_t*)p; p += c*sizeof(uint16_t);
+    sched.gap_avg = (uint16_t*)p; p += c*sizeof(uint16_t);
+    sched.gap_max = (uint16_t*)p; p += c*sizeof(uint16_t);
+    ch_flags = p; p += c;
+    ch_prio = p; p += c;
+    ch_bin = p;
+    for(size_t ch=0;ch<num_ch;ch++) {
+        ch_freq[ch] = e[ch].f;
+        ch_fw[ch] = freq_word(e[ch].f);
+        ch_flags[ch] = e[ch].flags;
+        ch_prio[ch] = e[ch].prio;
+        ch_bin[ch] = COARSE_NONE;
+    }
+    free(e);
+
+    // Coarse sub-bands across each range; channels past COARSE_MAX stay
+    // out of the coarse stage and are always swept
+    coarse_st.n = 0;
+    for(size_t k=0;k<num_specs;k++) {
+        const PlanSpec* sp = &specs[k];
+        if(!(sp->flags & CH_GRID)) continue;
+        size_t first = coarse_st.n;
+        for(uint32_t f=sp->start; coarse_st.n<COARSE_MAX; f+=COARSE_STEP) {
+            coarse_st.fw[coarse_st.n] = freq_word(f + COARSE_STEP/2);
+            coarse_st.freq[coarse_st.n++] = f + COARSE_STEP/2;
+            if(sp->end - f < COARSE_STEP) break;
+        }
+        for(size_t ch=0;ch<num_ch;ch++) {
+            uint32_t f = ch_freq[ch];
+            size_t b = first + (f - sp->start) / COARSE_STEP;
+            if(ch_bin[ch] == COARSE_NONE && f >= sp->start && f <= sp->end && b < coarse_st.n) ch_bin[ch] = b;
+        }
+    }
+
+    for(size_t m=0;m<ScanModes;m++) {
+        plan_len[m] = 0;
+        for(size_t ch=0;ch<num_ch;ch++)
+            if(ch_flags[ch] & mode_mask[m]) plan[m][plan_len[m]++] = ch;
+    }
+}
+// Next scan mode with channels in the plan. A range-only plan has no
+// Static channels and a beacon-only one no Free grid. Before the plan is
+// built every mode counts as empty and the plain next one is returned.
+static ScanMode mode_next(ScanMode m) {
+    for(size_t k=1;k<=ScanModes;k++) {
+        ScanMode n = (m + k) % ScanModes;
+        if(plan_len[n]) return n;
+    }
+    return (m + 1) % ScanModes;
+}
+static void plan_free(void) {
+    free(plan_mem);
+    plan_mem = NULL;
+    num_ch = 0;
+}
+
+// Scheduler: channels on the hot list are revisited every
+// FRAME_MS * SCHED_HOT / score, i.e. within a frame once they are hot, and
+// active targets every TGT_REVISIT_MS. They only ever take every other
+// visit; the round-robin cursor gets the rest, so a cold channel still
+// comes up at least once per 2*cnt visits.
+static void sched_init(void) {
+    sched.nhot = 0;
+    sched.hot_turn = false;
+    for(size_t ch=0;ch<num_ch;ch++) {
+        sched.score[ch] = ch_prio[ch];
+        sched.last[ch] = 0;
+        sched.gap_avg[ch] = sched.gap_max[ch] = 0;
+    }
+    sched.resume = 0;
+}
+// Start the cursor at the first plan entry at or after sched.resume, so
+// a sweep cut short by a lock or a mode change carries on where it left
+// off instead of favouring the low end of the band
+static void sched_rebase(void) {
+    size_t lo = 0, hi = sched.cnt;
+    while(lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if(sched.plan[mid] < sched.resume) lo = mid + 1;
+        else hi = mid;
+    }
+    sched.base = lo < sched.cnt ? lo : 0;
+    sched.cursor = 0;
+}
+static void sched_begin(ScanMode m) {
+    sched.plan = plan[m];
+    sched.cnt = plan_len[m];
+    sched.mask = mode_mask[m];
+    sched_rebase();
+}
+// Fine pass of a coarse-to-fine sweep: keep grid channels in the active
+// sub-bands, every beacon, and channels the coarse stage doesn't cover
+static void sched_restrict(uint32_t bands) {
+    size_t n = 0;
+    for(size_t i=0;i<sched.cnt;i++) {
+        size_t ch = sched.plan[i];
+        if((ch_flags[ch] & CH_BEACON) || ch_bin[ch] == COARSE_NONE || (bands >> ch_bin[ch]) & 1)
+            sched.list[n++] = ch;
+    }
+    sched.plan = sched.list;
+    sched.cnt = n;
+    sched_rebase();
+}
+static inline bool sched_in_plan(size_t ch) {
+    return ch_flags[ch] & sched.mask;
+}
+// Next channel to visit; false once the cursor has covered the plan
+static bool sched_next(size_t* ch) {
+    if(sched.cursor >= sched.cnt) return false;
+    sched.hot_turn = !sched.hot_turn;
+    if(sched.hot_turn) {
+        uint32_t now = furi_get_tick();
+        int32_t best_late = 0;
+        int best = -1;
+        for(size_t k=0;k<sched.nhot;k++) {
+            size_t c = sched.hot[k];
+            if(!sched_in_plan(c)) continue;
+            float s = sched.score[c] < SCHED_HOT ? sched.score[c] : SCHED_HOT;
+            int32_t late = (int32_t)(now - sched.last[c]) - (int32_t)ticks(FRAME_MS * SCHED_HOT / s);
+            if(late >= best_late) { best_late = late; best = c; }
+        }
+        for(size_t k=0;k<tgt.n;k++) {
+            size_t c = tgt.t[k].ch;
+            int32_t late = (int32_t)(now - sched.last[c]) - (int32_t)ticks(TGT_REVISIT_MS);
+            if(late >= best_late) { best_late = late; best = c; }
+        }
+        if(best >= 0) { *ch = best; return true; }
+    }
+    // The second radio's channels are left out of the round robin; hot
+    // and target picks still take them, as confirming needs this radio
+    while(sched.cursor < sched.cnt) {
+        size_t c = sched.plan[(sched.base + sched.cursor++) % sched.cnt];
+        if(ch_flags[c] & CH_ASSIST) continue;
+        *ch = c;
+        sched.resume = c + 1;
+        return true;
+    }
+    return false;
+}
+// Score a visit: decays with time, grows with margin over the floor and hits
+static void sched_visit(size_t ch, Rssi r, bool hit) {
+    uint32_t now = furi_get_tick();
+    float s = sched.score[ch] * expf(-(float)tick_ms(now - sched.last[ch]) / SCHED_TAU_MS);
+    int32_t margin = r - baseline.med[ch];
+    if(margin > 0) s += (float)margin / RSSI_DB(THRESH_DB);
+    if(hit) s += SCHED_HIT;
+    if(s < ch_prio[ch]) s = ch_prio[ch];
+    sched.score[ch] = s;
+    if(sched.last[ch]) {
+        uint32_t gap = tick_ms(now - sched.last[ch]);
+        if(gap > UINT16_MAX) gap = UINT16_MAX;
+        int32_t avg = sched.gap_avg[ch];
+        sched.gap_avg[ch] = avg ? avg + (((int32_t)gap - avg) >> GAP_AVG_SHIFT) : (int32_t)gap;
+        if(gap > sched.gap_max[ch]) sched.gap_max[ch] = gap;
+    }
+    sched.last[ch] = now;
+
+    // Keep the hot list holding the best-scoring channels
+    size_t k, low = 0;
+    for(k=0;k<sched.nhot&&sched.hot[k]!=ch;k++)
+        if(sched.score[sched.hot[k]] < sched.score[sched.hot[low]]) low = k;
+    if(k < sched.nhot) {
+        if(s < SCHED_WARM) sched.hot[k] = sched.hot[--sched.nhot];
+    } else if(s >= SCHED_WARM) {
+        if(sched.nhot < SCHED_SLOTS) sched.hot[sched.nhot++] = ch;
+        else if(s > sched.score[sched.hot[low]]) sched.hot[low] = ch;
+    }
+}
+
+// Waterfall: the worker folds each sweep into one row of per-column peak
+// dBm over the mode's frequency span and pushes it into a ring of WF_ROWS
+// rows. The UI thread shades only the new rows into a 1-bit bitmap that is
+// itself a ring, so a redraw is two xbm blits however long the history.
+static struct {
+    int8_t hist[WF_ROWS][WF_W];
+    int8_t acc[WF_W];             // row being swept (worker)
+    uint32_t lo, hi;              // its frequency span
+    uint32_t head;                // rows pushed (worker)
+    uint32_t painted;             // rows shaded (UI)
+    uint8_t bits[WF_ROWS][WF_W/8]; // under snap_mutex
+    size_t top;                   // bitmap row holding the newest sweep
+    uint32_t shown_lo, shown_hi;  // span of the bitmap, under snap_mutex
+} wf;
+
+static void wf_begin(ScanMode m) {
+    memset(wf.acc, WF_EMPTY, sizeof(wf.acc));
+    if(plan_len[m]) {
+        wf.lo = chan_freq(plan[m][0]);
+        wf.hi = chan_freq(plan[m][plan_len[m]-1]);
+    }
+}
+static void wf_add(size_t ch, Rssi r) {
+    uint32_t f = chan_freq(ch);
+    if(f < wf.lo || f > wf.hi) return;
+    size_t x = wf.hi > wf.lo ? (uint64_t)(f - wf.lo) * (WF_W-1) / (wf.hi - wf.lo) : 0;
+    int32_t v = (r + (1 << (RSSI_Q - 1))) >> RSSI_Q;
+    if(v < INT8_MIN + 1) v = INT8_MIN + 1;
+    if(v > INT8_MAX) v = INT8_MAX;
+    if(v > wf.acc[x]) wf.acc[x] = v;
+}
+static void wf_commit(void) {
+    memcpy(wf.hist[wf.head % WF_ROWS], wf.acc, WF_W);
+    __atomic_store_n(&wf.head, wf.head + 1, __ATOMIC_RELEASE);
+}
+// UI thread: shade rows pushed since the last call; true if any were
+static bool wf_paint(void) {
+    uint32_t head = __atomic_load_n(&wf.head, __ATOMIC_ACQUIRE);
+    if(head == wf.painted) return false;
+    if(head - wf.painted > WF_ROWS) wf.painted = head - WF_ROWS;
+    furi_mutex_acquire(snap_mutex, FuriWaitForever);
+    for(;wf.painted!=head;wf.painted++) {
+        const int8_t* row = wf.hist[wf.painted % WF_ROWS];
+        uint32_t y = wf.painted;
+        wf.top = (wf.top + WF_ROWS - 1) % WF_ROWS;
+        uint8_t* b = wf.bits[wf.top];
+        memset(b, 0, WF_W/8);
+        for(size_t x=0;x<WF_W;x++) {
+            if(row[x] == WF_EMPTY || row[x] < MIN_RSSI_DBM) continue;
+            // Ordered dither: 1/4, 1/2, then solid per WF_DB step
+            int lvl = (row[x] - (int)MIN_RSSI_DBM) / WF_DB;
+            bool on = lvl >= 3 || (lvl == 2 && ((x ^ y) & 1)) || (lvl == 1 && !(x & 1) && !(y & 1));
+            if(on) b[x/8] |= 1 << (x%8);
+        }
+    }
+    wf.shown_lo = wf.lo;
+    wf.shown_hi = wf.hi;
+    furi_mutex_release(snap_mutex);
+    return true;
+}
+
+static uint32_t cap_dropped(void) {
+    return cap.drop_full + cap.drop_io;
+}
+static int32_t cap_writer(void* ctx) {
+    UNUSED(ctx);
+    for(;;) {
+        // Sample the stop flag first so the last flush sees every record
+        bool stop = !__atomic_load_n(&cap.on, __ATOMIC_ACQUIRE);
+        uint32_t tail = cap.tail;
+        uint32_t pending = __atomic_load_n(&cap.head, __ATOMIC_ACQUIRE) - tail;
+        if(pending >= CAP_CHUNK || (stop && pending)) {
+            size_t n = pending < CAP_CHUNK ? pending : CAP_CHUNK;
+            n = MIN(n, CAP_RING - tail % CAP_RING); // never write past the ring end
+            size_t bytes = n * sizeof(CapRec);
+            if(storage_file_write(cap.file, &cap.ring[tail % CAP_RING], bytes) == bytes) cap.records += n;
+            else cap.drop_io += n;
+            __atomic_store_n(&cap.tail, tail + n, __ATOMIC_RELEASE);
+            continue;
+        }
+        if(stop) break;
+        furi_delay_ms(CAP_POLL_MS);
+    }
+    CapHeader hdr = {CAP_MAGIC, CAP_VERSION, CAP_HDR, sizeof(CapRec), 2,
+                     furi_kernel_get_tick_frequency(), baseline.plan, num_ch, cap.records, cap_dropped()};
+    storage_file_seek(cap.file, 0, true);
+    storage_file_write(cap.file, &hdr, sizeof(hdr));
+    return 0;
+}
+// Called from the UI thread; the worker only sees cap.on
+static bool cap_start(void) {
+    if(cap.thread) return true;
+    char path[48];
+    cap.storage = furi_record_open(RECORD_STORAGE);
+    cap.file = storage_file_alloc(cap.storage);
+    bool ok = false;
+    for(unsigned i=0;i<1000&&!ok;i++) {
+        snprintf(path,sizeof(path),APP_DATA_PATH("cap_%03u.bin"),i);
+        if(storage_common_exists(cap.storage, path)) continue;
+        ok = storage_file_open(cap.file, path, FSAM_WRITE, FSOM_CREATE_NEW);
+        break;
+    }
+    if(ok) {
+        // Placeholder header block, filled in on stop
+        static const uint8_t zero[CAP_HDR];
+        ok = storage_file_write(cap.file, zero, sizeof(zero)) == sizeof(zero);
+    }
+    if(!ok) {
+        storage_file_close(cap.file);
+        storage_file_free(cap.file);
+        furi_record_close(RECORD_STORAGE);
+        return false;
+    }
+    // Back to a chunk-aligned ring; the last stop may have flushed a
+    // partial chunk. The worker doesn't touch head while cap.on is false.
+    cap.head = cap.tail = 0;
+    cap.drop_full = cap.drop_io = cap.records = 0;
+    __atomic_store_n(&cap.on, true, __ATOMIC_RELEASE);
+    cap.thread = furi_thread_alloc_ex("TetraCap", CAP_STACK, cap_writer, NULL);
+    furi_thread_set_priority(cap.thread, FuriThreadPriorityLow);
+    furi_thread_start(cap.thread);
+    return true;
+}
+static void cap_stop(void) {
+    if(!cap.thread) return;
+    __atomic_store_n(&cap.on, false, __ATOMIC_RELEASE);
+    furi_thread_join(cap.thread);
+    furi_thread_free(cap.thread);
+    cap.thread = NULL;
+    storage_file_close(cap.file);
+    storage_file_free(cap.file);
+    furi_record_close(RECORD_STORAGE);
+}
+
+// Settings: every runtime knob, saved to SD as one value per entry in
+// table order. An entry either indexes names directly (vals NULL) or
+// maps its index through vals; the menu edits the variables live.
+typedef struct {
+    const char* name;
+    void* var;
+    uint8_t size;             // sizeof(*var)
+    uint8_t count;
+    const uint32_t* vals;     // NULL: the value is the index
+    const char* const* names; // NULL: vals printed with unit
+    const char* unit;
+} Setting;
+static const char* const onoff[] = {"Off", "On"};
+static const char* const hold_names[] = {"5 s", "10 s", "20 s", "30 s", "60 s"};
+static const uint32_t sens_vals[] = {1, 2, 3, 4, 5};
+static const uint32_t thresh_vals[] = {4, 5, 6, 7, 8, 9, 10, 12, 14};
+static const uint32_t drop_vals[] = {0, 2, 3, 5, 8};
+static const uint32_t hold_vals[] = {5000, 10000, 20000, 30000, 60000};
+static const uint32_t dwell_vals[] = {20, 30, 40, SCAN_MS, 85, 114};
+static const uint32_t settle_vals[] = {100, 200, RSSI_SETTLE_US, 500, 1000};
+#define SET_LIST(v)        COUNT_OF(v), v
+#define SET_BOOL(s, v)     {s, &v, sizeof(v), 2, NULL, onoff, NULL}
+static const Setting settings[] = {
+    {"Alert", &mode, sizeof(mode), COUNT_OF(mode_names), NULL, mode_names, NULL},
+    {"Scan", &scan_mode, sizeof(scan_mode), ScanModes, NULL, scan_names, NULL},
+    {"Sensitivity", &det.sens, sizeof(det.sens), SET_LIST(sens_vals), NULL, ""},
+    {"Threshold", &det.thresh_db, sizeof(det.thresh_db), SET_LIST(thresh_vals), NULL, " dB"},
+    {"Target relief", &det.tgt_drop_db, sizeof(det.tgt_drop_db), SET_LIST(drop_vals), NULL, " dB"},
+    {"Target hold", &det.hold_ms, sizeof(det.hold_ms), SET_LIST(hold_vals), hold_names, NULL},
+    {"Dwell", &dwell_ms, sizeof(dwell_ms), SET_LIST(dwell_vals), NULL, " ms"},
+    {"RSSI settle", &settle_us, sizeof(settle_us), SET_LIST(settle_vals), NULL, " us"},
+    SET_BOOL("TDMA", tdma),
+    SET_BOOL("Carrier sense", cs_irq),
+    SET_BOOL("Coarse pass", coarse),
+    SET_BOOL("Tracking", track),
+    SET_BOOL("Low power", low_power),
+    SET_BOOL("Dual radio", dual),
+    SET_BOOL("Debug view", debug),
+    SET_BOOL("Bench log", bench_log),
+};
+#define SET_N              COUNT_OF(settings)
+static uint32_t set_get(const Setting* s) {
+    switch(s->size) {
+        case 1: return *(uint8_t*)s->var;
+        case 2: return *(uint16_t*)s->var;
+        default: return *(uint32_t*)s->var;
+    }
+}
+static void set_put(const Setting* s, uint32_t v) {
+    switch(s->size) {
+        case 1: *(uint8_t*)s->var = v; break;
+        case 2: *(uint16_t*)s->var = v; break;
+        default: *(uint32_t*)s->var = v; break;
+    }
+}
+// Index of a value, the nearest listed one above it if it isn't listed
+static uint8_t set_index(const Setting* s, uint32_t v) {
+    if(!s->vals) return v < s->count ? v : 0;
+    uint8_t i = 0;
+    while(i < s->count - 1 && s->vals[i] < v) i++;
+    return i;
+}
+static void set_apply(const Setting* s, uint8_t i) {
+    set_put(s, s->vals ? s->vals[i] : i);
+    if(s->var == &det.thresh_db) rethr_req = true;
+}
+static void settings_load(void) {
+    uint32_t v[SET_N];
+    if(!saved_struct_load(SET_PATH, v, sizeof(v), SET_MAGIC, SET_VERSION)) return;
+    for(size_t k=0;k<SET_N;k++) set_apply(&settings[k], set_index(&settings[k], v[k]));
+}
+static void settings_save(void) {
+    uint32_t v[SET_N];
+    for(size_t k=0;k<SET_N;k++) v[k] = set_get(&settings[k]);
+    saved_struct_save(SET_PATH, v, sizeof(v), SET_MAGIC, SET_VERSION);
+}
+static void set_label(VariableItem* item, const Setting* s, uint8_t i) {
+    char buf[16];
+    if(s->names) variable_item_set_current_value_text(item, s->names[i]);
+    else {
+        snprintf(buf,sizeof(buf),"%lu%s",(unsigned long)s->vals[i],s->unit);
+        variable_item_set_current_value_text(item, buf);
+    }
+}
+static void set_changed(VariableItem* item) {
+    const Setting* s = variable_item_get_context(item);
+    uint8_t i = variable_item_get_current_value_index(item);
+    set_apply(s, i);
+    set_label(item, s, i);
+}
+// Back out of the list: false stops the dispatcher
+static bool settings_back(void* ctx) {
+    UNUSED(ctx);
+    return false;
+}
+// Settings menu, run on the UI thread until Back; the worker keeps
+// scanning with each value as soon as it is changed
+static void settings_run(Gui* gui, ViewPort* vp) {
+    gui_remove_view_port(gui, vp);
+    ViewDispatcher* vd = view_dispatcher_alloc();
+    VariableItemList* list = variable_item_list_alloc();
+    for(size_t k=0;k<SET_N;k++) {
+        const Setting* s = &settings[k];
+        VariableItem* item = variable_item_list_add(list, s->name, s->count, set_changed, (void*)s);
+        uint8_t i = set_index(s, set_get(s));
+        variable_item_set_current_value_index(item, i);
+        set_label(item, s, i);
+    }
+    view_dispatcher_set_navigation_event_callback(vd, settings_back);
+    view_dispatcher_add_view(vd, 0, variable_item_list_get_view(list));
+    view_dispatcher_attach_to_gui(vd, gui, ViewDispatcherTypeFullscreen);
+    view_dispatcher_switch_to_view(vd, 0);
+    view_dispatcher_run(vd);
+    view_dispatcher_remove_view(vd, 0);
+    variable_item_list_free(list);
+    view_dispatcher_free(vd);
+    gui_add_view_port(gui, vp, GuiLayerFullscreen);
+    settings_save();
+}
+
+// Input handler (GUI thread): forward to the UI loop
 static void input_cb(InputEvent* e, void* ctx) {
-    bool* exit = ctx;
-    if(e->type == InputTypePress) {
+    UNUSED(ctx);
+    Event ev = {.type = EvInput, .input = *e};
+    furi_message_queue_put(queue, &ev, 0);
+}
+// Returns true when the app should exit
+static bool settings_req; // long OK: the UI loop opens the settings menu
+static bool handle_input(const InputEvent* e, Snapshot* v) {
+    bool exit = false;
+    char* popup = v->popup;
+    size_t popup_len = sizeof(v->popup);
+    if(e->type == InputTypeLong && e->key == InputKeyUp) {
+        const char* msg = "Off";
+        if(cap.thread) cap_stop();
+        else msg = cap_start() ? "On" : "SD error";
+        snprintf(popup,popup_len,"Capture: %s",msg);
+        v->cap = cap.thread != NULL;
+        v->popup_until = furi_get_tick() + ticks(POPUP_MS);
+        notification_message(notif, &sequence_semi_success);
+    } else if(e->type == InputTypeLong && e->key == InputKeyOk) {
+        settings_req = true;
+    } else if(e->type == InputTypeLong && e->key == InputKeyRight) {
+        low_power = !low_power;
+        snprintf(popup,popup_len,"Low power: %s",low_power?"On":"Off");
+        v->popup_until = furi_get_tick() + ticks(POPUP_MS);
+        notification_message(notif, &sequence_semi_success);
+    } else if(e->type == InputTypeLong && e->key == InputKeyLeft) {
+        dual = !dual;
+        snprintf(popup,popup_len,"Dual radio: %s",dual?"On":"Off");
+        v->popup_until = furi_get_tick() + ticks(POPUP_MS);
+        notification_message(notif, &sequence_semi_success);
+    } else if(e->type == InputTypeLong && e->key == InputKeyDown) {
+        screen = (screen + 1) % Screens;
+        v->screen = screen;
+        // Entering the benchmark screen starts a fresh run
+        if(screen == ScreenBench) {
+            v->bench.done = false;
+            bench_req = true;
+        }
+    } else if(e->type == InputTypeShort) {
         switch(e->key) {
             case InputKeyUp:
                 mode = (mode + 1) % 6;
-                snprintf(popup,sizeof(popup),"Mode: %s",mode_names[mode]);
+                snprintf(popup,popup_len,"Mode: %s",mode_names[mode]);
                 break;
             case InputKeyLeft:
-                free_scan = !free_scan;
-                snprintf(popup,sizeof(popup),"Scan: %s",scan_names[free_scan]);
+                scan_mode = mode_next(scan_mode);
+                snprintf(popup,popup_len,"Scan: %s",scan_names[scan_mode]);
                 break;
             case InputKeyRight:
-                sens = (sens < 5 ? sens + 1 : 1);
-                snprintf(popup,sizeof(popup),"Sens: %d",sens);
+                det.sens = (det.sens < 5 ? det.sens + 1 : 1);
+                snprintf(popup,popup_len,"Sens: %d",det.sens);
                 break;
             case InputKeyDown:
                 debug = !debug;
-                snprintf(popup,sizeof(popup),"Debug: %s",debug?"On":"Off");
+                snprintf(popup,popup_len,"Debug: %s",debug?"On":"Off");
                 break;
             case InputKeyOk:
                 tdma = !tdma;
-                snprintf(popup,sizeof(popup),"TDMA: %s",tdma?"On":"Off");
+                snprintf(popup,popup_len,"TDMA: %s",tdma?"On":"Off");
                 break;
             case InputKeyBack:
-                *exit = true;
+                exit = true;
                 break;
             default: break;
         }
-        popup_until = furi_get_tick() + ticks(POPUP_MS);
-        notification_message_block(notif, &sequence_semi_success);
+        v->screen = screen;
+        v->popup_until = furi_get_tick() + ticks(POPUP_MS);
+        v->scan_mode = scan_mode;
+        v->debug = debug;
+        v->tdma = tdma;
+        notification_message(notif, &sequence_semi_success);
     }
+    return exit;
 }
+// Publish the UI copy to render(); true if anything visible changed
+static bool publish(const Snapshot* v) {
+    bool changed;
+    furi_mutex_acquire(snap_mutex, FuriWaitForever);
+    changed = memcmp(&snap, v, sizeof(snap)) != 0;
+    if(changed) memcpy(&snap, v, sizeof(snap));
+    furi_mutex_release(snap_mutex);
+    return changed;
+}
+
+// Render-side text cache: a line is only re-formatted and re-measured
+// when the value it shows changes. Only touched by the GUI thread.
+typedef struct {
+    uint64_t key;
+    bool ok;
+    int w;
+    char s[24];
+} Txt;
+static const Txt* txt(Canvas* c, Txt* t, uint64_t key, const char* fmt, ...) {
+    if(t->ok && t->key == key) return t;
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(t->s, sizeof(t->s), fmt, ap);
+    va_end(ap);
+    t->w = canvas_string_width(c, t->s);
+    t->key = key;
+    t->ok = true;
+    return t;
+}
+static struct {
+    Txt lo, hi, freq, rssi, sweep, drop, status;
+    char popup[32];
+    int popup_w;
+    int name_w[ScanModes], lw_y, lw_n;
+    bool init;
+} rc;
 
 // Render callback
-typedef struct { float r; uint32_t f; bool p; } State;
-static void render(Canvas* c, void* ctx) {
-    State* st = ctx;
-    float r = st->r;
-    uint32_t f = st->f;
-    bool p = st->p;
+static void draw(Canvas* c, void* ctx) {
+    UNUSED(ctx);
+    Snapshot s;
+    furi_mutex_acquire(snap_mutex, FuriWaitForever);
+    memcpy(&s, &snap, sizeof(s));
+    furi_mutex_release(snap_mutex);
+    float r = RSSI_TO_F(s.scan.r);
+    uint32_t f = s.scan.f;
+    bool p = s.scan.p;
+    uint32_t sw = s.scan.sw;
 
     canvas_clear(c);
     int w = canvas_width(c);
     int h = canvas_height(c);
     int fh = canvas_current_font_height(c);
+    if(!rc.init) {
+        for(size_t k=0;k<ScanModes;k++) rc.name_w[k] = canvas_string_width(c, scan_names[k]);
+        rc.lw_y = canvas_string_width(c, "T:Y");
+        rc.lw_n = canvas_string_width(c, "T:N");
+        rc.init = true;
+    }
 
-    // Top hints
-    canvas_draw_str(c, 2, fh, scan_names[free_scan]);
-    canvas_draw_str(c, w-60, fh, tdma?"TDMA On":"TDMA Off");
+    // Waterfall: newest sweep on top, frequency left to right, span and
+    // scan mode in the top line
+    if(s.screen == ScreenWaterfall) {
+        furi_mutex_acquire(snap_mutex, FuriWaitForever);
+        uint32_t lo = wf.shown_lo, hi = wf.shown_hi;
+        size_t n = WF_ROWS - wf.top;
+        canvas_draw_xbm(c, 0, WF_Y, WF_W, n, wf.bits[wf.top]);
+        if(wf.top) canvas_draw_xbm(c, 0, WF_Y + n, WF_W, wf.top, wf.bits[0]);
+        furi_mutex_release(snap_mutex);
+        canvas_draw_str(c, (w-rc.name_w[s.scan_mode])/2, fh, scan_names[s.scan_mode]);
+        if(hi) {
+            canvas_draw_str(c, 2, fh, txt(c, &rc.lo, lo, "%lu.%01lu",
+                (unsigned long)(lo/1000000), (unsigned long)((lo%1000000)/100000))->s);
+            const Txt* t = txt(c, &rc.hi, hi, "%lu.%01lu",
+                (unsigned long)(hi/1000000), (unsigned long)((hi%1000000)/100000));
+            canvas_draw_str(c, w-t->w-2, fh, t->s);
+        }
+        canvas_draw_box(c, 0, WF_Y-2, w, 1);
+    } else if(s.screen != ScreenBench && s.screen != ScreenStats) {
+        // Top hints
+        canvas_draw_str(c, 2, fh, scan_names[s.scan_mode]);
+        canvas_draw_str(c, w-60, fh, s.tdma?"TDMA On":"TDMA Off");
+        if(s.cap) canvas_draw_disc(c, w-66, fh/2+1, 2); // recording
+    }
 
-    // Popup
-    if(popup[0] && furi_get_tick() < popup_until) {
+    // Popup (cleared by the UI thread once it expires)
+    if(s.popup[0]) {
+        const char* popup = s.popup;
+        if(strcmp(rc.popup, popup)) {
+            snprintf(rc.popup, sizeof(rc.popup), "%s", popup);
+            rc.popup_w = canvas_string_width(c, popup);
+        }
         int box_h = fh + 6;
-        int pw = canvas_string_width(c, popup) + 8;
+        int pw = rc.popup_w + 8;
         int px = (w - pw)/2;
         int py = fh*2 + 4;
         canvas_draw_box(c, px, py, pw, box_h);
@@ -140,27 +1416,108 @@ static void render(Canvas* c, void* ctx) {
         canvas_draw_str(c, px+4, py + (box_h - fh)/2 + 1, popup);
         canvas_set_color(c, ColorBlack);
     }
+    if(s.screen == ScreenWaterfall) return;
+
+    // Debug view, in place of the main view only
+    if(s.debug && s.screen == ScreenMain) {
+        canvas_draw_str(c,2,fh*3,txt(c, &rc.freq, f, "Freq: %lu.%03lu MHz",
+            (unsigned long)(f/1000000), (unsigned long)((f%1000000)/1000))->s);
+        canvas_draw_str(c,2,fh*4+4,p?"Packet: YES":"Packet: NO");
+        if(s.tdma) {
+            // Slot occupancy: '#' busy, '.' idle, '?' no phase yet
+            char sl[8] = "S:????";
+            for(int k=0;k<4&&s.scan.slots!=TDMA_NO_PHASE;k++)
+                sl[2+k] = (s.scan.slots >> k) & 1 ? '#' : '.';
+            canvas_draw_str(c, w-canvas_string_width(c, sl)-2, fh*4+4, sl);
+        }
+        canvas_draw_str(c,2,fh*5+8,txt(c, &rc.rssi, (uint16_t)s.scan.r, "RSSI: %.1f dBm", (double)r)->s);
+        // Target indicator bottom-right
+        canvas_draw_str(c, w-(s.scan.l?rc.lw_y:rc.lw_n)-2, fh*5+8, s.scan.l?"T:Y":"T:N");
+        // Sweep time, then this channel's average/worst revisit interval
+        canvas_draw_str(c,2,fh*6+12,txt(c, &rc.sweep,
+            (uint64_t)sw << 32 | (uint32_t)s.scan.gap_avg << 16 | s.scan.gap_max,
+            "Sw:%lu Rv:%u/%u", (unsigned long)sw, s.scan.gap_avg, s.scan.gap_max)->s);
+        if(s.cap) {
+            const Txt* t = txt(c, &rc.drop, s.cap_drop, "D:%lu", (unsigned long)s.cap_drop);
+            canvas_draw_str(c, w-t->w-2, fh*6+12, t->s);
+        }
+        return;
+    }
 
-    // Debug view
-    if(debug) {
+    // Benchmark: min/mean/p99 per item, in us
+    if(s.screen == ScreenBench) {
         char buf[32];
-        snprintf(buf,sizeof(buf),"Freq: %lu.%03lu MHz", (unsigned long)(f/1000000), (unsigned long)((f%1000000)/1000));
-        canvas_draw_str(c,2,fh*3,buf);
-        snprintf(buf,sizeof(buf),"Packet: %s", p?"YES":"NO");
-        canvas_draw_str(c,2,fh*4+4,buf);
-        snprintf(buf,sizeof(buf),"RSSI: %.1f dBm", (double)r);
-        canvas_draw_str(c,2,fh*5+8,buf);
-        // Lock indicator bottom-right
-        char lstr[4]; snprintf(lstr, sizeof(lstr),"L:%c", locked? 'Y':'N');
-        int lw = canvas_string_width(c, lstr);
-        canvas_draw_str(c, w-lw-2, fh*5+8, lstr);
+        canvas_set_font(c, FontSecondary);
+        int lh = canvas_current_font_height(c);
+        if(!s.bench.done) {
+            canvas_draw_str(c,2,lh*2,"Benchmark running...");
+        } else {
+            canvas_draw_str(c,2,lh,"us        min   mean    p99");
+            for(size_t k=0;k<BenchItems;k++) {
+                const BenchStat* b = &s.bench.s[k];
+                snprintf(buf,sizeof(buf),"%-7s %6lu %6lu %6lu", bench_names[k],
+                    (unsigned long)b->min, (unsigned long)b->mean, (unsigned long)b->p99);
+                canvas_draw_str(c,2,lh*(k+2)+1,buf);
+            }
+        }
+        canvas_set_font(c, FontPrimary);
+        return;
+    }
+
+    // Channel statistics: frequency, hits, share of visits with a hit and
+    // mean dBm, then the RSSI histogram of the top channel
+    if(s.screen == ScreenStats) {
+        char buf[32];
+        canvas_set_font(c, FontSecondary);
+        int lh = canvas_current_font_height(c);
+        if(!s.stats.n) canvas_draw_str(c,2,lh*2,"Collecting...");
+        for(size_t k=0;k<s.stats.n;k++) {
+            const ChStat* st = &s.stats.s[k];
+            uint32_t sf = chan_freq(s.stats.ch[k]);
+            snprintf(buf,sizeof(buf),"%lu.%03lu x%u %lu%% %d",
+                (unsigned long)(sf/1000000), (unsigned long)((sf%1000000)/1000), st->hits,
+                (unsigned long)(st->hits * 100ULL / st->n), stat_mean(st) >> RSSI_Q);
+            canvas_draw_str(c,2,lh*(k+1)+1,buf);
+        }
+        if(s.stats.n) {
+            const uint8_t* hist = s.stats.s[0].hist;
+            int top = lh*(STAT_SHOW+1)+3, bw = w / STAT_BINS;
+            uint8_t max = 1;
+            for(size_t k=0;k<STAT_BINS;k++) if(hist[k] > max) max = hist[k];
+            for(size_t k=0;k<STAT_BINS;k++) {
+                int bh = hist[k] * (h - top) / max;
+                if(bh) canvas_draw_box(c, k*bw+1, h-bh, bw-2, bh);
+            }
+            canvas_draw_line(c, 0, h-1, w-1, h-1);
+        }
+        canvas_set_font(c, FontPrimary);
+        return;
+    }
+
+    // Active targets, strongest first: frequency, avg/peak dBm, hits and
+    // seconds since the last hit
+    if(s.screen == ScreenTargets) {
+        char buf[32];
+        snprintf(buf,sizeof(buf),"Targets: %u", s.targets.n);
+        canvas_draw_str(c,2,fh*2+2,buf);
+        uint32_t now = furi_get_tick();
+        for(size_t k=0;k<s.targets.n;k++) {
+            const Target* t = &s.targets.t[k];
+            uint32_t tf = chan_freq(t->ch);
+            snprintf(buf,sizeof(buf),"%lu.%03lu %d/%d x%u %lus",
+                (unsigned long)(tf/1000000), (unsigned long)((tf%1000000)/1000),
+                (int)lroundf(RSSI_TO_F(t->avg)), (int)lroundf(RSSI_TO_F(t->peak)), t->hits,
+                (unsigned long)(tick_ms(now - t->last)/1000));
+            canvas_draw_str(c,2,fh*(3+k)+4,buf);
+        }
         return;
     }
 
     // Main view
-    const char* status = p?"Locked":"Scanning";
-    int tw = canvas_string_width(c,status);
-    canvas_draw_str(c,(w-tw)/2,fh*2,status);
+    static const char* const status[] = {"Calibrating", "Detected", "Targets: %u", "Scanning"};
+    uint8_t st = s.scan.c ? 0 : p ? 1 : s.targets.n ? 2 : 3;
+    const Txt* t = txt(c, &rc.status, st << 8 | s.targets.n, status[st], s.targets.n);
+    canvas_draw_str(c,(w-t->w)/2,fh*2,t->s);
 
     // Strength bar
     int bx=8, by=(h/2)-6, bw=w-16, bh=12;
@@ -178,72 +1535,687 @@ static void render(Canvas* c, void* ctx) {
     }
 }
 
+static void render(Canvas* c, void* ctx) {
+    uint32_t t0 = cyc();
+    draw(c, ctx);
+    redraw_cyc[redraw_n++ % BENCH_N] = cyc() - t0;
+}
+
+// Radio worker: owns the CC1101 and posts scan results to the UI queue
+static void post(EventType type, const State* st) {
+    Event ev = {.type = type, .scan = *st};
+    furi_message_queue_put(queue, &ev, type == EvAlert ? ticks(SCAN_MS) : 0);
+}
+
+// Calibration: CAL_SAMPLES readings per channel reduced to a median and a
+// trimmed variance. The table is cached on SD per frequency plan, so later
+// launches only spot-check CAL_VERIFY_CH channels.
+static uint32_t plan_hash(void) {
+    uint32_t h = 2166136261U; // FNV-1a
+    for(size_t i=0;i<num_ch;i++) { h ^= chan_freq(i); h *= 16777619U; }
+    return h;
+}
+static void cal_path(char* path, size_t len) {
+    snprintf(path,len,APP_DATA_PATH("cal_%08lx.bin"),(unsigned long)baseline.plan);
+}
+static size_t cal_size(void) {
+    return num_ch * (sizeof(Rssi) + sizeof(uint16_t)); // med and var
+}
+static void cal_reduce(size_t i, Rssi* s) {
+    for(size_t k=1;k<CAL_SAMPLES;k++) { // insertion sort, CAL_SAMPLES is small
+        Rssi v = s[k];
+        size_t j = k;
+        for(;j>0&&s[j-1]>v;j--) s[j] = s[j-1];
+        s[j] = v;
+    }
+    int32_t med = (CAL_SAMPLES&1)? s[CAL_SAMPLES/2] : (s[CAL_SAMPLES/2-1]+s[CAL_SAMPLES/2])/2;
+    // Spread around the median without the extremes, so a burst caught
+    // during calibration doesn't inflate the channel's margin
+    int32_t var = 0;
+    for(size_t k=CAL_TRIM;k<CAL_SAMPLES-CAL_TRIM;k++) var += ((s[k]-med)*(s[k]-med)) >> RSSI_Q;
+    var /= CAL_SAMPLES - 2*CAL_TRIM;
+    // The seed is capped so a carrier already on air during calibration
+    // can't raise its own threshold out of reach; tracking takes over
+    baseline.med[i] = med < RSSI_DB(MIN_RSSI_DBM) ? med : RSSI_DB(MIN_RSSI_DBM);
+    baseline.var[i] = var > UINT16_MAX ? UINT16_MAX : var;
+}
+static void cal_channel(size_t i) {
+    Rssi s[CAL_SAMPLES];
+    s[0] = read_ch(i);
+    for(size_t k=1;k<CAL_SAMPLES;k++) {
+        furi_delay_ms(CAL_DELAY_MS);
+        s[k] = rssi_now();
+    }
+    cal_reduce(i, s);
+}
+// Cold calibration, CAL_BLOCK channels at a time: each round samples the
+// whole block through the batch sampler, so the round itself spaces a
+// channel's samples; short blocks are padded to CAL_DELAY_MS
+static void cal_block(size_t first, size_t n) {
+    static uint16_t chs[CAL_BLOCK];
+    static Rssi s[CAL_BLOCK][CAL_SAMPLES], r[CAL_BLOCK];
+    for(size_t j=0;j<n;j++) chs[j] = first + j;
+    for(size_t k=0;k<CAL_SAMPLES&&running;k++) {
+        uint32_t t0 = cyc();
+        sample_channels(chs, n, r, NULL, NULL);
+        for(size_t j=0;j<n;j++) s[j][k] = r[j];
+        wait_until(t0, CAL_DELAY_MS * 1000);
+    }
+    for(size_t j=0;j<n;j++) cal_reduce(first + j, s[j]);
+}
+static void calibrate(State* st) {
+    char path[48];
+    uint32_t plan = plan_hash();
+    baseline.plan = plan;
+    cal_path(path,sizeof(path));
+    size_t size = cal_size();
+    bool warm = saved_struct_load(path,baseline.med,size,CAL_MAGIC,CAL_VERSION);
+    st->c = true;
+    // Warm start: re-measure a few spread-out channels against the cache
+    for(size_t k=0;warm&&k<CAL_VERIFY_CH&&running;k++) {
+        size_t i = k*(num_ch-1)/(CAL_VERIFY_CH-1);
+        int32_t old = baseline.med[i];
+        cal_channel(i);
+        if(abs(baseline.med[i]-old) > RSSI_DB(CAL_VERIFY_DB)) warm = false;
+    }
+    if(!warm) {
+        for(size_t i=0;i<num_ch&&running;i+=CAL_BLOCK) {
+            size_t n = MIN(num_ch - i, (size_t)CAL_BLOCK);
+            cal_block(i, n);
+            st->r = baseline.med[i+n-1]; st->f = chan_freq(i+n-1);
+            post(EvScan, st);
+        }
+        if(running) saved_struct_save(path,baseline.med,size,CAL_MAGIC,CAL_VERSION);
+    }
+    det_rethr(num_ch);
+    baseline_valid = running;
+    st->c = false;
+}
+// Keep the tracked floor for the next launch's warm start
+static void cal_save(void) {
+    if(!baseline_valid) return;
+    char path[48];
+    cal_path(path,sizeof(path));
+    saved_struct_save(path,baseline.med,cal_size(),CAL_MAGIC,CAL_VERSION);
+}
+
+// Target tracking: quick-sample the plan channels within TRACK_SPAN of the
+// target and return the one to move to, or ch itself. A neighbour has to be
+// over its own threshold, beat the target's margin by TRACK_HYST and pass
+// burst confirmation; *r gets its RSSI.
+static size_t track_best(size_t ch, int32_t margin, Rssi* r) {
+    size_t nb[TRACK_MAX], n = 0;
+    uint32_t f = chan_freq(ch);
+    for(size_t i=ch; i-- > 0 && n < TRACK_MAX && f - chan_freq(i) <= TRACK_SPAN;) nb[n++] = i;
+    for(size_t i=ch+1; i < num_ch && n < TRACK_MAX && chan_freq(i) - f <= TRACK_SPAN; i++) nb[n++] = i;
+    size_t best = ch;
+    int32_t best_m = margin + RSSI_DB(TRACK_HYST);
+    Rssi best_r = 0;
+    for(size_t k=0;k<n;k++) {
+        Rssi rn = read_ch(nb[k]);
+        int32_t m = rn - chan_thr(nb[k]);
+        if(m > 0 && m > best_m) { best = nb[k]; best_m = m; best_r = rn; }
+    }
+    if(best == ch) return ch;
+    read_ch(best);
+    if(!confirmed(confirm(chan_thr(best), CONFIRM_M))) return ch;
+    *r = best_r;
+    return best;
+}
+
+// Follow a hop or an off-grid carrier: on a revisit of target k, check its
+// neighbours on a low duty cycle, and on every revisit once it has gone
+// quiet. Returns the target's channel afterwards; if it moved, *r holds
+// the new channel's RSSI.
+static size_t tgt_track(size_t k, Rssi r0, Rssi* r, uint32_t now) {
+    Target* t = &tgt.t[k];
+    size_t ch = t->ch;
+    if(!track || (t->miss < TRACK_LOST && ++t->visits % TRACK_EVERY)) return ch;
+    size_t nb = track_best(ch, r0 - chan_thr(ch), r);
+    if(nb == ch) return ch;
+    if(tgt_find(nb) >= 0) tgt_remove(k); // merges into the one already there
+    else t->ch = nb;
+    tgt_hit(nb, *r, now);
+    return nb;
+}
+// Strongest TGT_SHOW targets to the UI
+static void tgt_publish(void) {
+    Event ev = {.type = EvTargets};
+    TargetList* l = &ev.targets;
+    for(size_t k=0;k<tgt.n;k++) {
+        const Target* c = &tgt.t[k];
+        size_t j = l->n;
+        for(;j>0&&l->t[j-1].avg<c->avg;j--) if(j < TGT_SHOW) l->t[j] = l->t[j-1];
+        if(j < TGT_SHOW) {
+            l->t[j] = *c;
+            if(l->n < TGT_SHOW) l->n++;
+        }
+    }
+    furi_message_queue_put(queue, &ev, 0);
+}
+
+// Stats screen feed: the STAT_SHOW channels with most hits, ties (and
+// the all-quiet case) going to the louder mean
+static bool stat_above(const ChStat* a, const ChStat* b) {
+    return a->hits != b->hits ? a->hits > b->hits : stat_mean(a) > stat_mean(b);
+}
+static void stat_publish(void) {
+    Event ev = {.type = EvStats};
+    StatList* l = &ev.stats;
+    for(size_t ch=0;ch<num_ch;ch++) {
+        const ChStat* c = &ch_stat[ch];
+        if(!c->n) continue;
+        size_t j = l->n;
+        for(;j>0&&stat_above(c, &l->s[j-1]);j--)
+            if(j < STAT_SHOW) { l->s[j] = l->s[j-1]; l->ch[j] = l->ch[j-1]; }
+        if(j < STAT_SHOW) {
+            l->s[j] = *c;
+            l->ch[j] = ch;
+            if(l->n < STAT_SHOW) l->n++;
+        }
+    }
+    furi_message_queue_put(queue, &ev, 0);
+}
+static void stat_export(void) {
+    Storage* storage = furi_record_open(RECORD_STORAGE);
+    File* file = storage_file_alloc(storage);
+    if(storage_file_open(file, STAT_PATH, FSAM_WRITE, FSOM_CREATE_ALWAYS)) {
+        char line[96];
+        storage_file_write(file, STAT_CSV_HEAD, strlen(STAT_CSV_HEAD));
+        for(size_t ch=0;ch<num_ch;ch++) {
+            if(!ch_stat[ch].n) continue;
+            int n = stat_csv(line, sizeof(line), chan_freq(ch), &ch_stat[ch]);
+            storage_file_write(file, line, n);
+        }
+    }
+    storage_file_close(file);
+    storage_file_free(file);
+    furi_record_close(RECORD_STORAGE);
+}
+
+// Benchmark: time the pieces of a visit on this unit and radio module.
+// Retunes alternate between the ends of the plan so the PLL always has
+// to move; sweeps are quick-sample only, without dwells.
+static void bench_stat(BenchStat* b, uint32_t* v, size_t n) {
+    if(!n) { *b = (BenchStat){0, 0, 0}; return; }
+    uint64_t sum = 0;
+    for(size_t k=1;k<n;k++) {
+        uint32_t x = v[k];
+        size_t j = k;
+        for(;j>0&&v[j-1]>x;j--) v[j] = v[j-1];
+        v[j] = x;
+    }
+    for(size_t k=0;k<n;k++) sum += v[k];
+    b->min = v[0];
+    b->mean = sum / n;
+    b->p99 = v[(n*99 + 99)/100 - 1];
+}
+static void bench_csv(const BenchResult* res) {
+    Storage* storage = furi_record_open(RECORD_STORAGE);
+    File* file = storage_file_alloc(storage);
+    bool fresh = !storage_common_exists(storage, BENCH_PATH);
+    if(storage_file_open(file, BENCH_PATH, FSAM_WRITE, FSOM_OPEN_APPEND)) {
+        char line[64];
+        int n;
+        if(fresh) {
+            n = snprintf(line,sizeof(line),"tick,item,min_us,mean_us,p99_us\n");
+            storage_file_write(file, line, n);
+        }
+        for(size_t k=0;k<BenchItems;k++) {
+            const BenchStat* b = &res->s[k];
+            n = snprintf(line,sizeof(line),"%lu,%s,%lu,%lu,%lu\n", (unsigned long)furi_get_tick(),
+                bench_names[k], (unsigned long)b->min, (unsigned long)b->mean, (unsigned long)b->p99);
+            storage_file_write(file, line, n);
+        }
+    }
+    storage_file_close(file);
+    storage_file_free(file);
+    furi_record_close(RECORD_STORAGE);
+}
+static void bench_run(void) {
+    static uint32_t v[BenchItems][BENCH_N]; // too big for the worker stack
+    size_t n[BenchItems] = {0};
+    uint32_t ipus = furi_hal_cortex_instructions_per_microsecond();
+    radio_idle();
+    for(size_t k=0;k<BENCH_N&&running;k++) {
+        size_t ch = k & 1 ? num_ch-1 : 0;
+        furi_hal_subghz_idle();
+        uint32_t c0 = cyc();
+        radio_set_word(ch_fw[ch], &ch_cal[ch]);
+        uint32_t c1 = cyc();
+        radio_rx();
+        radio_settle();
+        uint32_t c2 = cyc();
+        radio.freq = chan_freq(ch);
+        radio.state = RadioRx;
+        rssi_now();
+        uint32_t c3 = cyc();
+        v[BenchSetFreq][n[BenchSetFreq]++] = (c1 - c0) / ipus;
+        v[BenchSettle][n[BenchSettle]++] = (c2 - c1) / ipus;
+        v[BenchRssi][n[BenchRssi]++] = (c3 - c2) / ipus;
+    }
+    for(size_t k=0;k<BENCH_N&&running;k++) {
+        uint32_t c0 = cyc();
+        confirm(chan_thr(0), CONFIRM_M);
+        v[BenchConfirm][n[BenchConfirm]++] = (cyc() - c0) / ipus;
+    }
+    for(size_t m=ScanStatic;m<=ScanFree;m++) {
+        BenchItem item = m == ScanStatic ? BenchSweepStatic : BenchSweepFree;
+        for(size_t k=0;k<BENCH_SWEEPS&&plan_len[m]&&running;k++) {
+            uint32_t c0 = cyc();
+            sample_channels(plan[m], plan_len[m], NULL, NULL, NULL);
+            v[item][n[item]++] = (cyc() - c0) / ipus;
+        }
+    }
+    n[BenchRedraw] = redraw_n < BENCH_N ? redraw_n : BENCH_N;
+    for(size_t k=0;k<n[BenchRedraw];k++) v[BenchRedraw][k] = redraw_cyc[k] / ipus;
+
+    Event ev = {.type = EvBench};
+    for(size_t k=0;k<BenchItems;k++) bench_stat(&ev.bench.s[k], v[k], n[k]);
+    ev.bench.done = true;
+    if(bench_log && running) bench_csv(&ev.bench);
+    furi_message_queue_put(queue, &ev, 0);
+}
+
+// One scan visit of ch from its quick sample r0: candidates get a dwell
+// and targets a confirmation, back on the channel; then the scheduler,
+// stats, capture, waterfall, floor and target table are fed. Only
+// candidates and targets use the radio.
+typedef struct {
+    State* state;
+    bool quiet; // no candidate this sweep
+} Sweep;
+static void visit(Sweep* sw, size_t ch, Rssi r0) {
+    State* st = sw->state;
+    uint32_t now = furi_get_tick();
+    cap.sub_ch = ch;
+    bool changed = tgt_expire(now);
+    int t = tgt_find(ch);
+    uint32_t freq = chan_freq(ch);
+    Rssi thr = chan_thr(ch);
+    bool cand, pk, rej = false;
+    if(t >= 0) {
+        // Revisit: one slot of confirmation at a relaxed threshold, or
+        // in TDMA mode the slot centres at the target's stored phase,
+        // acquired again first if it was lost
+        thr = tgt_thr(ch);
+        cand = r0>thr;
+        if(cand) tune_ch(ch);
+        if(cand && tdma)
+            pk = (tdma_report(ch) != TDMA_NO_PHASE || tdma_acquire(ch, thr)) && tdma_slots(ch, thr);
+        else
+            pk = cand&&confirmed(confirm(thr, CONFIRM_M));
+    } else {
+        cand = r0>thr-RSSI_DB(PRE_DB);
+        rej = cand && det_rejected(ch, now);
+        if(cand && !rej) tune_ch(ch);
+        pk = cand&&!rej&&dwell(ch, thr);
+        if(pk && !accept(ch, thr, now)) { pk = false; rej = true; }
+    }
+    sched_visit(ch, r0, pk);
+    stat_add(&ch_stat[ch], r0, pk, tick_ms(now));
+    cap_log(ch, r0, thr, (cand ? CAP_CAND : 0) | (pk ? CAP_PEAK : 0) | (t >= 0 ? CAP_TGT : 0) |
+        (rej ? CAP_REJ : 0));
+    wf_add(ch, r0);
+    if(!pk && t < 0) floor_update(ch, r0);
+    if(cand) sw->quiet = false;
+    bool fresh = false;
+    if(pk) fresh = tgt_hit(ch, r0, now);
+    else if(t >= 0) tgt.t[t].miss++;
+    if(t >= 0) {
+        size_t nb = tgt_track(t, r0, &r0, now);
+        if(nb != ch) {
+            ch = nb;
+            freq = chan_freq(ch);
+            pk = changed = true;
+        }
+    }
+    st->r=r0; st->f=freq; st->p=pk; st->l=tgt_find(ch) >= 0;
+    st->slots = tdma_report(ch);
+    st->gap_avg = sched.gap_avg[ch]; st->gap_max = sched.gap_max[ch];
+    // alert is played by the UI thread, once per new target;
+    // nothing else is worth waking it for while the display is off
+    if(fresh || !ui_dark) post(fresh ? EvAlert : EvScan, st);
+    if(fresh || changed) tgt_publish();
+}
+// Batch verdicts while the next channel settles: anything short of a
+// candidate is finished on the spot, candidates wait for the batch end
+typedef struct {
+    Sweep* sw;
+    uint16_t ch[SCAN_BATCH];
+    Rssi r[SCAN_BATCH];
+    uint32_t cand; // bit k: ch[k] needs a dwell
+    size_t n;
+} Batch;
+static void batch_eval(size_t i, Rssi r, void* ctx) {
+    Batch* b = ctx;
+    if(r > chan_thr(b->ch[i]) - RSSI_DB(PRE_DB)) b->cand |= 1U << i;
+    else visit(b->sw, b->ch[i], r);
+}
+
+// Second radio: an external CC1101 module, driven through the subghz
+// device layer on its own thread. It takes every other channel of the
+// mode's plan and streams one quick sample per channel to the worker,
+// which runs them through visit() like its own, so detection state stays
+// single-threaded and a candidate is confirmed on the main radio while
+// the module keeps sweeping. Both chips share the SPI bus but not the
+// settle waits, which are most of a quick sample.
+typedef struct { uint16_t ch; Rssi r; } AssistSample;
+static struct {
+    const SubGhzDevice* dev; // NULL: no external radio driver
+    FuriThread* thread;
+    FuriMessageQueue* q;
+    volatile bool on;
+    volatile bool pause; // low-power gap: module asleep until cleared
+    bool otg;      // 5 V enabled here for the module
+    ScanMode mode;
+    uint16_t* list;
+    size_t n;
+    size_t pos;    // next list entry, kept across pauses
+    Rssi off;      // module RSSI minus main radio floor, learnt once
+    int32_t cal_sum;
+    size_t cal_n;
+} assist;
+static Rssi assist_read(size_t ch) {
+    subghz_devices_idle(assist.dev);
+    subghz_devices_set_frequency(assist.dev, ch_freq[ch]); // calibrates
+    subghz_devices_set_rx(assist.dev);
+    furi_delay_us(RX_ENTRY_US + settle_us);
+    return (Rssi)lroundf(subghz_devices_get_rssi(assist.dev) * (1 << RSSI_Q));
+}
+static int32_t assist_worker(void* ctx) {
+    UNUSED(ctx);
+    while(assist.on) {
+        if(assist.pause) {
+            // Asleep across the gap, then the preset again, as sleep loses
+            // the TEST registers and the PA table
+            subghz_devices_sleep(assist.dev);
+            while(assist.pause && assist.on) furi_delay_ms(LP_SLICE_MS);
+            subghz_devices_idle(assist.dev);
+            subghz_devices_load_preset(assist.dev, ASSIST_PRESET, NULL);
+            continue;
+        }
+        if(!assist.n) { furi_delay_ms(LP_SLICE_MS); continue; }
+        size_t ch = assist.list[assist.pos];
+        assist.pos = (assist.pos + 1) % assist.n;
+        AssistSample s = {ch, assist_read(ch)};
+        // The floors come from the main radio; the module's filter and
+        // front-end differ, so the first samples only set its offset
+        if(assist.cal_n < ASSIST_CAL) {
+            int32_t d = s.r - baseline.med[s.ch];
+            assist.cal_sum += CLAMP(d, RSSI_DB(ASSIST_CAL_DB), -RSSI_DB(ASSIST_CAL_DB));
+            if(++assist.cal_n == ASSIST_CAL) assist.off = assist.cal_sum / ASSIST_CAL;
+            continue;
+        }
+        s.r -= assist.off;
+        while(assist.on && !assist.pause &&
+              furi_message_queue_put(assist.q, &s, ticks(ASSIST_PUT_MS)) != FuriStatusOk);
+    }
+    return 0;
+}
+static bool assist_start(ScanMode m) {
+    if(!assist.dev) return false;
+    assist.otg = !furi_hal_power_is_otg_enabled();
+    if(assist.otg) furi_hal_power_enable_otg();
+    if(!subghz_devices_is_connect(assist.dev) || !subghz_devices_begin(assist.dev)) {
+        if(assist.otg) furi_hal_power_disable_otg();
+        return false;
+    }
+    subghz_devices_reset(assist.dev);
+    subghz_devices_load_preset(assist.dev, ASSIST_PRESET, NULL);
+    assist.list = malloc(sizeof(uint16_t) * (plan_len[m] / 2 + 1));
+    assist.n = assist.pos = 0;
+    for(size_t i=1;i<plan_len[m];i+=2) {
+        ch_flags[plan[m][i]] |= CH_ASSIST;
+        assist.list[assist.n++] = plan[m][i];
+    }
+    assist.mode = m;
+    assist.pause = false;
+    assist.q = furi_message_queue_alloc(ASSIST_QUEUE, sizeof(AssistSample));
+    assist.on = true;
+    assist.thread = furi_thread_alloc_ex("TetraAssist", ASSIST_STACK, assist_worker, NULL);
+    furi_thread_start(assist.thread);
+    return true;
+}
+// Samples still queued are dropped; their channels go back to the main
+// radio's round robin
+static void assist_stop(void) {
+    if(!assist.thread) return;
+    assist.on = false;
+    furi_thread_join(assist.thread);
+    furi_thread_free(assist.thread);
+    assist.thread = NULL;
+    furi_message_queue_free(assist.q);
+    subghz_devices_sleep(assist.dev);
+    subghz_devices_end(assist.dev);
+    if(assist.otg) furi_hal_power_disable_otg();
+    for(size_t i=0;i<assist.n;i++) ch_flags[assist.list[i]] &= ~CH_ASSIST;
+    free(assist.list);
+    assist.n = 0;
+}
+static void assist_drain(Sweep* sw) {
+    if(!assist.thread) return;
+    AssistSample s;
+    while(furi_message_queue_get(assist.q, &s, 0) == FuriStatusOk) visit(sw, s.ch, s.r);
+}
+
+static int32_t scan_worker(void* ctx) {
+    UNUSED(ctx);
+    State state={RSSI_DB(MIN_RSSI_DBM),UP_START_FREQ,false,false,false,TDMA_NO_PHASE,0,0,0};
+
+    det_init(&cc1101_det);
+    plan_load();
+    plan_build();
+    if(!plan_len[scan_mode]) scan_mode = mode_next(scan_mode);
+    fast_begin();
+    calibrate(&state);
+    sched_init();
+    cs_begin();
+    uint32_t sweeps = 0;
+    uint32_t lp_gap = 0;
+
+    while(running) {
+        if(assist.thread && (!dual || bench_req || assist.mode != scan_mode)) assist_stop();
+        if(bench_req) {
+            bench_run();
+            bench_req = false;
+            continue;
+        }
+        // One quick sample per channel, dwell only on candidates, channel
+        // order from the scheduler. Known targets get short revisits folded
+        // into the sweep instead of stopping it.
+        if(rethr_req) {
+            rethr_req = false;
+            det_rethr(num_ch);
+        }
+        if(dual && !assist.thread && !assist_start(scan_mode)) {
+            dual = false;
+            assist_missing = true;
+        }
+        assist.pause = false;
+        sched_begin(scan_mode);
+        if(!sched.cnt) { // mode picked in settings has no channels
+            furi_delay_ms(UI_POLL_MS);
+            continue;
+        }
+        wf_begin(scan_mode);
+        uint32_t sweep_start = furi_get_tick();
+        if(sweep_start - fscal_at >= ticks(FSCAL_REFRESH_MS)) fscal_refresh();
+        if(coarse && scan_mode != ScanStatic && sweeps % COARSE_FULL_EVERY) sched_restrict(coarse_pass());
+        bool swept = true;
+        Sweep sw = {&state, true};
+        bool more = true;
+        while(more) {
+            if(!running || bench_req) { swept = false; break; }
+            assist_drain(&sw);
+            // Gather a batch from the scheduler. A hot channel picked twice
+            // is sampled once; a target revisit ends the batch and is
+            // visited on its own, as it confirms on the channel right away.
+            Batch bt = {.sw = &sw};
+            size_t ch;
+            bool tv = false;
+            while(bt.n < SCAN_BATCH && (more = sched_next(&ch))) {
+                if(tgt_find(ch) >= 0) { tv = true; break; }
+                bool dup = false;
+                for(size_t k=0;k<bt.n;k++) dup |= bt.ch[k] == ch;
+                if(!dup) bt.ch[bt.n++] = ch;
+            }
+            sample_channels(bt.ch, bt.n, bt.r, batch_eval, &bt);
+            for(size_t k=0;k<bt.n;k++) if(bt.cand & (1U << k)) visit(&sw, bt.ch[k], bt.r[k]);
+            if(tv) visit(&sw, ch, read_ch(ch));
+        }
+        assist_drain(&sw);
+        wf_commit();
+        tgt_publish();
+        if(screen == ScreenStats) stat_publish();
+        if(swept) {
+            state.sw = tick_ms(furi_get_tick() - sweep_start);
+            sweeps++;
+        }
+        // Low power: with no targets, power the radio down until the next
+        // sweep, backing off while the band stays quiet. Any candidate
+        // shortens the gap again, a hit stops it until the target expires.
+        if(!low_power || tgt.n || !swept) {
+            lp_gap = 0;
+            continue;
+        }
+        lp_gap = !sw.quiet || !lp_gap ? LP_GAP_MIN_MS : MIN(lp_gap * 2, (uint32_t)LP_GAP_MAX_MS);
+        assist.pause = true; // the module sleeps too, but stays set up
+        radio_sleep();
+        for(uint32_t t=0;t<lp_gap && running && low_power && !bench_req;t+=LP_SLICE_MS)
+            furi_delay_ms(LP_SLICE_MS);
+    }
+    assist_stop();
+    cs_end();
+    radio_idle();
+    fast_end();
+    cal_save();
+    stat_export();
+    plan_free();
+    return 0;
+}
+
 int32_t python_detector_app(void) {
-    furi_hal_subghz_set_path(FuriHalSubGhzPathExternal);
+    furi_hal_subghz_set_path(FuriHalSubGhzPathExternal);
     Gui* gui = furi_record_open("gui");
     notif = furi_record_open("notification");
     if(!gui||!notif) return -1;
 
-    // Calibrate
-    for(size_t i=0;i<UP_NUM_CH;i++) {
-        baseline[i] = read_rssi(UP_START_FREQ + i*FREQ_STEP);
-        furi_delay_ms(CAL_DELAY_MS);
-    }
-
+    queue = furi_message_queue_alloc(QUEUE_LEN, sizeof(Event));
+    snap_mutex = furi_mutex_alloc(FuriMutexTypeNormal);
+    subghz_devices_init();
+    assist.dev = subghz_devices_get_by_name(ASSIST_DEVICE);
+    settings_load();
+    static Snapshot view; // UI copy and the event below stay off the app stack
+    memset(&view, 0, sizeof(view));
+    view.scan = (State){RSSI_DB(MIN_RSSI_DBM),UP_START_FREQ,false,false,true,TDMA_NO_PHASE,0,0,0};
+    view.scan_mode = scan_mode;
+    view.debug = debug;
+    view.tdma = tdma;
+    publish(&view);
     ViewPort* vp = view_port_alloc();
-    State state={MIN_RSSI_DBM,UP_START_FREQ,false};
-    bool exit=false;
-    view_port_draw_callback_set(vp,render,&state);
-    view_port_input_callback_set(vp,input_cb,&exit);
+    view_port_draw_callback_set(vp,render,NULL);
+    view_port_input_callback_set(vp,input_cb,NULL);
     gui_add_view_port(gui,vp,GuiLayerFullscreen);
 
+    running = true;
+    FuriThread* worker = furi_thread_alloc_ex("TetraScan", WORKER_STACK, scan_worker, NULL);
+    furi_thread_start(worker);
+
+    // UI loop: drain events and redraw, never touches the radio
+    bool exit=false;
+    static Event ev;
+    uint32_t last_input = furi_get_tick();
+    uint32_t last_frame = 0, wait = ticks(UI_POLL_MS);
     while(!exit) {
-        uint32_t now = furi_get_tick();
-        // Locked behaviour
-        if(locked) {
-            uint32_t freq = state.f;
-            float r0=read_rssi(freq);
-            // original threshold
-            float base = free_scan? baseline[(freq-UP_START_FREQ)/FREQ_STEP]
-                                    : MIN_RSSI_DBM;
-            float thr = base + THRESH_DB - sens - LOCK_RSSI_DROP;
-            bool pk=(r0>thr)&&persist(thr);
-            if(pk) lock_start = now; // reset hold timer
-            else if(now - lock_start > ticks(LOCK_HOLD_MS)) {
-                locked=false; // unlock
+        // Drain everything queued so far, then publish once
+        FuriStatus got = furi_message_queue_get(queue,&ev,wait);
+        bool wake = false;
+        while(got==FuriStatusOk && !exit) {
+            switch(ev.type) {
+                case EvInput:
+                    exit = handle_input(&ev.input, &view);
+                    if(settings_req) {
+                        settings_req = false;
+                        settings_run(gui, vp);
+                        view.scan_mode = scan_mode;
+                        view.debug = debug;
+                        view.tdma = tdma;
+                    }
+                    last_input = furi_get_tick();
+                    wake = true;
+                    break;
+                case EvAlert:
+                    notification_message(notif, &sequence_audiovisual_alert);
+                    view.scan = ev.scan;
+                    wake = true;
+                    break;
+                case EvScan:
+                    view.scan = ev.scan;
+                    break;
+                case EvTargets:
+                    view.targets = ev.targets;
+                    break;
+                case EvStats:
+                    view.stats = ev.stats;
+                    break;
+                case EvBench:
+                    view.bench = ev.bench;
+                    break;
             }
-            state.r=r0; state.f=freq; state.p=pk;
-            view_port_update(vp);
-            furi_delay_ms(SCAN_MS);
-            continue;
+            got = furi_message_queue_get(queue,&ev,0);
         }
-        // Scanning behaviour
-        size_t cnt = free_scan? UP_NUM_CH : STATIC_CH;
-        for(size_t i=0;i<cnt&&!exit;i++) {
-            uint32_t freq = free_scan? (UP_START_FREQ+i*FREQ_STEP) : STATIC_FREQS[i];
-            float r0=read_rssi(freq);
-            float base = free_scan? baseline[i] : MIN_RSSI_DBM;
-            float thr = base + THRESH_DB - sens;
-            bool pk=(r0>thr)&&persist(thr);
-            if(pk) {
-                // lock on detection
-                locked=true;
-                lock_start = now;
-                state.f=freq;
-                // alert
-                notification_message_block(notif, &sequence_audiovisual_alert);
-                break;
-            }
-            state.r=r0; state.f=freq; state.p=pk;
-            view_port_update(vp);
-            furi_delay_ms(SCAN_MS);
+        if(assist_missing) {
+            assist_missing = false;
+            snprintf(view.popup,sizeof(view.popup),"Dual radio: no module");
+            view.popup_until = furi_get_tick() + ticks(POPUP_MS);
+        }
+        if(view.popup[0] && (int32_t)(furi_get_tick() - view.popup_until) >= 0) view.popup[0] = '\0';
+        if(view.cap) view.cap_drop = cap_dropped();
+        view.scan_mode = scan_mode; // the worker may skip an empty mode
+        if(plan_cut) {
+            snprintf(view.popup,sizeof(view.popup),"Plan: %u ch dropped",(unsigned)plan_cut);
+            view.popup_until = furi_get_tick() + ticks(POPUP_MS);
+            plan_cut = 0;
         }
+        // Low power: backlight off after LP_DIM_MS without input, back on
+        // for a key press or a new target
+        if(ui_dark && (wake || !low_power)) {
+            notification_message(notif, &sequence_display_backlight_on);
+            ui_dark = false;
+        } else if(!ui_dark && low_power && furi_get_tick() - last_input >= ticks(LP_DIM_MS)) {
+            notification_message(notif, &sequence_display_backlight_off);
+            ui_dark = true;
+        }
+        // At most one frame per UI_FRAME_MS however fast results arrive;
+        // events in between only update the local copy. Input draws at once.
+        uint32_t since = furi_get_tick() - last_frame;
+        if(!wake && since < ticks(UI_FRAME_MS)) {
+            wait = ticks(UI_FRAME_MS) - since;
+            continue;
+        }
+        wait = ticks(ui_dark ? LP_UI_POLL_MS : UI_POLL_MS);
+        last_frame = furi_get_tick();
+        // Redraw only when something visible actually changed
+        bool dirty = publish(&view) || wake;
+        if(wf_paint() && view.screen == ScreenWaterfall) dirty = true;
+        if(dirty && !ui_dark) view_port_update(vp);
     }
+    if(ui_dark) notification_message(notif, &sequence_display_backlight_on);
+
+    running = false;
+    furi_thread_join(worker);
+    furi_thread_free(worker);
+    cap_stop();
+    settings_save(); // short-press toggles too
 
     gui_remove_view_port(gui,vp);
     view_port_free(vp);
+    furi_message_queue_free(queue);
+    furi_mutex_free(snap_mutex);
+    subghz_devices_deinit();
     furi_record_close("gui");
     furi_record_close("notification");
-    furi_hal_subghz_set_path(FuriHalSubGhzPathInternal);
+    furi_hal_subghz_set_path(FuriHalSubGhzPathInternal);
     return 0;
 }